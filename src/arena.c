@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "arena.h"
+
+static void insertBlock(FreeList *list, int at, int offset, int size) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->blocks = realloc(list->blocks, list->capacity * sizeof(ArenaBlock));
+    }
+    memmove(&list->blocks[at + 1], &list->blocks[at], (list->count - at) * sizeof(ArenaBlock));
+    list->blocks[at] = (ArenaBlock){offset, size};
+    list->count++;
+}
+
+static void removeBlock(FreeList *list, int at) {
+    memmove(&list->blocks[at], &list->blocks[at + 1], (list->count - at - 1) * sizeof(ArenaBlock));
+    list->count--;
+}
+
+// Returns a range to the list, merging it with free neighbours
+static void releaseRange(FreeList *list, int offset, int size) {
+    int at = 0;
+    while (at < list->count && list->blocks[at].offset < offset) at++;
+
+    int mergePrev = at > 0 && list->blocks[at - 1].offset + list->blocks[at - 1].size == offset;
+    int mergeNext = at < list->count && offset + size == list->blocks[at].offset;
+    if (mergePrev && mergeNext) {
+        list->blocks[at - 1].size += size + list->blocks[at].size;
+        removeBlock(list, at);
+    } else if (mergePrev) {
+        list->blocks[at - 1].size += size;
+    } else if (mergeNext) {
+        list->blocks[at].offset = offset;
+        list->blocks[at].size += size;
+    } else {
+        insertBlock(list, at, offset, size);
+    }
+}
+
+// First fit. Returns the offset or -1 when no free range is large enough.
+static int reserveRange(FreeList *list, int size) {
+    for (int i = 0; i < list->count; i++) {
+        ArenaBlock *block = &list->blocks[i];
+        if (block->size < size) continue;
+        int offset = block->offset;
+        block->offset += size;
+        block->size -= size;
+        if (block->size == 0) removeBlock(list, i);
+        return offset;
+    }
+    return -1;
+}
+
+// Grows the storage of buffer in place through a temporary copy, so every VAO that
+// references the buffer stays valid
+static void growBuffer(unsigned int buffer, int oldBytes, int newBytes) {
+    unsigned int temp;
+    glGenBuffers(1, &temp);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, temp);
+    glBufferData(GL_COPY_WRITE_BUFFER, oldBytes, NULL, GL_STATIC_COPY);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+
+    glBufferData(GL_COPY_READ_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, temp);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &temp);
+}
+
+static int allocateRange(FreeList *list, unsigned int buffer, int elementSize, int size) {
+    int offset = reserveRange(list, size);
+    if (offset >= 0)
+        return offset;
+
+    int newSize = list->size > 0 ? list->size : 1;
+    while (newSize - list->size < size) newSize *= 2;
+    printf("Geometry arena grows from %d to %d elements\n", list->size, newSize);
+    growBuffer(buffer, list->size * elementSize, newSize * elementSize);
+    releaseRange(list, list->size, newSize - list->size);
+    list->size = newSize;
+    return reserveRange(list, size);
+}
+
+GeometryArena *createGeometryArena(int vertexCapacity, int indexCapacity) {
+    GeometryArena *arena = calloc(1, sizeof(GeometryArena));
+    arena->vertices.size = vertexCapacity;
+    arena->indices.size = indexCapacity;
+    releaseRange(&arena->vertices, 0, vertexCapacity);
+    releaseRange(&arena->indices, 0, indexCapacity);
+
+    glGenVertexArrays(1, &arena->VAO);
+    glGenBuffers(1, &arena->VBO);
+    glGenBuffers(1, &arena->EBO);
+
+    glBindVertexArray(arena->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, arena->VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+    bindArenaAttributes(arena);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return arena;
+}
+
+// Copies the geometry into the arena. Indices stay relative to the mesh's first vertex.
+int allocateGeometry(GeometryArena *arena, const Vertex *vertices, int vertexCount,
+                     const unsigned int *indices, int indexCount, int *baseVertex, int *firstIndex) {
+    *baseVertex = allocateRange(&arena->vertices, arena->VBO, sizeof(Vertex), vertexCount);
+    if (*baseVertex < 0)
+        return 0;
+    *firstIndex = allocateRange(&arena->indices, arena->EBO, sizeof(unsigned int), indexCount);
+    if (*firstIndex < 0) {
+        // Nothing is placed unless both fit
+        releaseRange(&arena->vertices, *baseVertex, vertexCount);
+        *baseVertex = -1;
+        return 0;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, arena->VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)*baseVertex * sizeof(Vertex), vertexCount * sizeof(Vertex), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // The element binding is VAO state, so it goes through the copy target instead
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)*firstIndex * sizeof(unsigned int), indexCount * sizeof(unsigned int), indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return 1;
+}
+
+void freeGeometry(GeometryArena *arena, int baseVertex, int vertexCount, int firstIndex, int indexCount) {
+    if (vertexCount > 0) releaseRange(&arena->vertices, baseVertex, vertexCount);
+    if (indexCount > 0) releaseRange(&arena->indices, firstIndex, indexCount);
+}
+
+// Points attributes 0-2 of the bound VAO at the arena
+void bindArenaAttributes(const GeometryArena *arena) {
+    glBindBuffer(GL_ARRAY_BUFFER, arena->VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->EBO);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+}
+
+void destroyGeometryArena(GeometryArena *arena) {
+    glDeleteVertexArrays(1, &arena->VAO);
+    glDeleteBuffers(1, &arena->VBO);
+    glDeleteBuffers(1, &arena->EBO);
+    free(arena->vertices.blocks);
+    free(arena->indices.blocks);
+    free(arena);
+}
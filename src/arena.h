@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "math3d.h"
+
+#define ARENA_VERTICES  (1 << 16)   // Starting sizes, the arena grows when it runs out
+#define ARENA_INDICES   (1 << 16)
+
+typedef struct arenaBlock {
+    int offset, size;
+} ArenaBlock;
+
+// Free ranges of a buffer sorted by offset, in elements
+typedef struct freeList {
+    ArenaBlock *blocks;
+    int count, capacity;
+    int size;                       // Elements the buffer holds
+} FreeList;
+
+// All static geometry in one vertex and one index buffer behind a single VAO.
+// Meshes are told apart by their base vertex and first index.
+typedef struct geometryArena {
+    unsigned int VAO, VBO, EBO;
+    FreeList vertices, indices;
+} GeometryArena;
+
+GeometryArena *createGeometryArena(int vertexCapacity, int indexCapacity);
+int allocateGeometry(GeometryArena *arena, const Vertex *vertices, int vertexCount,
+                     const unsigned int *indices, int indexCount, int *baseVertex, int *firstIndex);
+void freeGeometry(GeometryArena *arena, int baseVertex, int vertexCount, int firstIndex, int indexCount);
+void bindArenaAttributes(const GeometryArena *arena);
+void destroyGeometryArena(GeometryArena *arena);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <GL/glew.h>
+#include "bench.h"
+
+Benchmark *createBenchmark(int frames) {
+    Benchmark *bench = calloc(1, sizeof(Benchmark));
+    bench->frames = frames;
+    bench->frameTimes = calloc(frames, sizeof(float));
+    bench->cpuTimes = calloc(frames, sizeof(float));
+    bench->gpuTimes = calloc(frames, sizeof(float));
+    bench->gpu = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (bench->gpu)
+        glGenQueries(BENCH_LATENCY * 2, &bench->queries[0][0]);
+    else
+        printf("Timer queries are not available, the benchmark reports no GPU time\n");
+    return bench;
+}
+
+// Position along the camera path, 0 through the warmup and up to 1 on the last frame
+float benchmarkProgress(const Benchmark *bench) {
+    int recorded = bench->frame - BENCH_WARMUP;
+    if (recorded <= 0 || bench->frames <= 1) return 0.0f;
+    return recorded / (float)(bench->frames - 1);
+}
+
+int benchmarkDone(const Benchmark *bench) {
+    return bench->frame >= BENCH_WARMUP + bench->frames;
+}
+
+static float ticksToMs(Uint64 ticks) {
+    return ticks * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+// Reads the timestamps of an earlier frame, blocking if the GPU is not done with it yet
+static void readGPUTime(Benchmark *bench, int frame) {
+    GLuint *pair = bench->queries[frame % BENCH_LATENCY];
+    GLuint64 start, end;
+    glGetQueryObjectui64v(pair[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(pair[1], GL_QUERY_RESULT, &end);
+    int recorded = frame - BENCH_WARMUP;
+    if (recorded >= 0 && recorded < bench->frames) {
+        bench->gpuTimes[recorded] = (end - start) / 1e6f;
+        bench->gpuCount++;
+    }
+}
+
+void beginBenchmarkFrame(Benchmark *bench) {
+    if (bench->gpu) {
+        // The query pair is reused every BENCH_LATENCY frames, its old result is read first
+        if (bench->frame >= BENCH_LATENCY)
+            readGPUTime(bench, bench->frame - BENCH_LATENCY);
+        glQueryCounter(bench->queries[bench->frame % BENCH_LATENCY][0], GL_TIMESTAMP);
+    }
+    bench->frameStart = SDL_GetPerformanceCounter();
+}
+
+// Everything for the frame has been submitted, the swap comes next
+void submitBenchmarkFrame(Benchmark *bench) {
+    int recorded = bench->frame - BENCH_WARMUP;
+    if (recorded >= 0 && recorded < bench->frames)
+        bench->cpuTimes[recorded] = ticksToMs(SDL_GetPerformanceCounter() - bench->frameStart);
+    if (bench->gpu)
+        glQueryCounter(bench->queries[bench->frame % BENCH_LATENCY][1], GL_TIMESTAMP);
+}
+
+void endBenchmarkFrame(Benchmark *bench) {
+    int recorded = bench->frame - BENCH_WARMUP;
+    if (recorded >= 0 && recorded < bench->frames)
+        bench->frameTimes[recorded] = ticksToMs(SDL_GetPerformanceCounter() - bench->frameStart);
+    bench->frame++;
+}
+
+static int compareFloats(const void *a, const void *b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Writes "name": {avg, p50, p95, p99, max} and returns the average
+static float writeTimes(FILE *fp, const char *name, const float *times, int count, int last) {
+    if (count == 0) {
+        fprintf(fp, "  \"%s\": null%s\n", name, last ? "" : ",");
+        return 0.0f;
+    }
+    float *sorted = malloc(count * sizeof(float));
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++) {
+        sorted[i] = times[i];
+        sum += times[i];
+    }
+    qsort(sorted, count, sizeof(float), compareFloats);
+    fprintf(fp, "  \"%s\": {\"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+            name, sum / count, sorted[count / 2], sorted[count * 95 / 100], sorted[count * 99 / 100],
+            sorted[count - 1], last ? "" : ",");
+    free(sorted);
+    return sum / count;
+}
+
+// Collects the GPU times still in flight, so needs the GL context
+int writeBenchmarkReport(Benchmark *bench, const BenchmarkScene *scene, const char *path) {
+    if (bench->gpu) {
+        for (int frame = bench->frame > BENCH_LATENCY ? bench->frame - BENCH_LATENCY : 0; frame < bench->frame; frame++) {
+            readGPUTime(bench, frame);
+        }
+    }
+    int recorded = bench->frame - BENCH_WARMUP;
+    if (recorded > bench->frames) recorded = bench->frames;
+    if (recorded < 0) recorded = 0;
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        printf("Could not open file %s\n", path);
+        return 0;
+    }
+    fprintf(fp, "{\n  \"frames\": %d,\n", recorded);
+    fprintf(fp, "  \"scene\": {\"width\": %d, \"height\": %d, \"meshes\": %d, \"instances\": %d, \"triangles\": %lld},\n",
+            scene->width, scene->height, scene->meshes, scene->instances, scene->triangles);
+    float frameTime = writeTimes(fp, "frame_ms", bench->frameTimes, recorded, 0);
+    float cpuTime = writeTimes(fp, "cpu_ms", bench->cpuTimes, recorded, 0);
+    float gpuTime = writeTimes(fp, "gpu_ms", bench->gpuTimes, bench->gpuCount, 1);
+    fprintf(fp, "}\n");
+    fclose(fp);
+
+    printf("Benchmark: %d frames, %.3f ms per frame (%.1f fps), %.3f ms CPU, %.3f ms GPU, written to %s\n",
+           recorded, frameTime, frameTime > 0.0f ? 1000.0f / frameTime : 0.0f, cpuTime, gpuTime, path);
+    return 1;
+}
+
+void destroyBenchmark(Benchmark *bench) {
+    if (bench->gpu)
+        glDeleteQueries(BENCH_LATENCY * 2, &bench->queries[0][0]);
+    free(bench->frameTimes);
+    free(bench->cpuTimes);
+    free(bench->gpuTimes);
+    free(bench);
+}
@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <SDL2/SDL.h>
+
+#define BENCH_WARMUP    30      // Frames rendered before recording starts
+#define BENCH_LATENCY   4       // Frames of timestamp queries in flight
+
+// Per frame timings over a fixed number of frames: frame time from the start
+// of one frame to the start of the next, CPU time up to the swap, and GPU time
+// between timestamps written at the start of the frame and just before the swap
+typedef struct benchmark {
+    int frames;                         // Recorded, the warmup comes on top
+    int frame;                          // Started so far, warmup included
+    float *frameTimes, *cpuTimes, *gpuTimes;
+    int gpuCount;
+    int gpu;                            // Timestamp queries are available
+    unsigned int queries[BENCH_LATENCY][2];
+    Uint64 frameStart;
+} Benchmark;
+
+typedef struct benchmarkScene {
+    int width, height;
+    int meshes, instances;
+    long long triangles;
+} BenchmarkScene;
+
+Benchmark *createBenchmark(int frames);
+float benchmarkProgress(const Benchmark *bench);
+int benchmarkDone(const Benchmark *bench);
+void beginBenchmarkFrame(Benchmark *bench);
+void submitBenchmarkFrame(Benchmark *bench);
+void endBenchmarkFrame(Benchmark *bench);
+int writeBenchmarkReport(Benchmark *bench, const BenchmarkScene *scene, const char *path);
+void destroyBenchmark(Benchmark *bench);
+
+#endif
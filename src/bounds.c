@@ -0,0 +1,203 @@
+#include <math.h>
+#include <float.h>
+#include "bounds.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BOUNDS_SSE
+#endif
+
+#ifdef BOUNDS_SSE
+// Loads x, y, z into the lower three lanes. The last point is loaded lane by lane
+// so tightly packed position arrays are never read past the end.
+static inline __m128 loadPoint(const float *positions, int i, int count, int stride) {
+    const float *p = positions + (long)i * stride;
+    if (i < count - 1 || stride > 3) {
+        return _mm_loadu_ps(p);
+    }
+    return _mm_set_ps(0.0f, p[2], p[1], p[0]);
+}
+#endif
+
+static float distanceSq(const float *a, const float *b) {
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Index of the point furthest away from p
+static int farthestPoint(const float *positions, int count, int stride, const float *p) {
+    int best = 0;
+    float bestDist = -1.0f;
+#ifdef BOUNDS_SSE
+    __m128 origin = _mm_set_ps(0.0f, p[2], p[1], p[0]);
+    __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    for (int i = 0; i < count; i++) {
+        __m128 d = _mm_and_ps(_mm_sub_ps(loadPoint(positions, i, count, stride), origin), mask);
+        d = _mm_mul_ps(d, d);
+        d = _mm_add_ps(d, _mm_movehl_ps(d, d));
+        d = _mm_add_ss(d, _mm_shuffle_ps(d, d, 1));
+        float dist = _mm_cvtss_f32(d);
+        if (dist > bestDist) {
+            bestDist = dist;
+            best = i;
+        }
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        float dist = distanceSq(positions + (long)i * stride, p);
+        if (dist > bestDist) {
+            bestDist = dist;
+            best = i;
+        }
+    }
+#endif
+    return best;
+}
+
+static void computeAABB(Bounds *b, const float *positions, int count, int stride) {
+#ifdef BOUNDS_SSE
+    __m128 lo = _mm_set1_ps(FLT_MAX);
+    __m128 hi = _mm_set1_ps(-FLT_MAX);
+    for (int i = 0; i < count; i++) {
+        __m128 p = loadPoint(positions, i, count, stride);
+        lo = _mm_min_ps(lo, p);
+        hi = _mm_max_ps(hi, p);
+    }
+    float tmpLo[4], tmpHi[4];
+    _mm_storeu_ps(tmpLo, lo);
+    _mm_storeu_ps(tmpHi, hi);
+    for (int k = 0; k < 3; k++) {
+        b->min[k] = tmpLo[k];
+        b->max[k] = tmpHi[k];
+    }
+#else
+    for (int k = 0; k < 3; k++) {
+        b->min[k] = FLT_MAX;
+        b->max[k] = -FLT_MAX;
+    }
+    for (int i = 0; i < count; i++) {
+        const float *p = positions + (long)i * stride;
+        for (int k = 0; k < 3; k++) {
+            if (p[k] < b->min[k]) b->min[k] = p[k];
+            if (p[k] > b->max[k]) b->max[k] = p[k];
+        }
+    }
+#endif
+}
+
+// Ritter's bounding sphere: start from two far apart points and grow the
+// sphere over every point that falls outside of it.
+static void computeSphere(Bounds *b, const float *positions, int count, int stride) {
+    const float *a = positions + (long)farthestPoint(positions, count, stride, positions) * stride;
+    const float *c = positions + (long)farthestPoint(positions, count, stride, a) * stride;
+
+    float center[3] = {(a[0] + c[0]) * 0.5f, (a[1] + c[1]) * 0.5f, (a[2] + c[2]) * 0.5f};
+    float radius = sqrtf(distanceSq(a, c)) * 0.5f;
+
+    for (int i = 0; i < count; i++) {
+        const float *p = positions + (long)i * stride;
+        float dist = distanceSq(p, center);
+        if (dist > radius * radius) {
+            dist = sqrtf(dist);
+            float newRadius = (radius + dist) * 0.5f;
+            float k = (newRadius - radius) / dist;
+            for (int j = 0; j < 3; j++) {
+                center[j] += (p[j] - center[j]) * k;
+            }
+            radius = newRadius;
+        }
+    }
+
+    // The box's circumscribed sphere is sometimes the tighter one
+    float boxCenter[3], boxRadius = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        boxCenter[k] = (b->min[k] + b->max[k]) * 0.5f;
+        float half = (b->max[k] - b->min[k]) * 0.5f;
+        boxRadius += half * half;
+    }
+    boxRadius = sqrtf(boxRadius);
+
+    if (boxRadius < radius) {
+        radius = boxRadius;
+        for (int k = 0; k < 3; k++) center[k] = boxCenter[k];
+    }
+
+    for (int k = 0; k < 3; k++) b->center[k] = center[k];
+    b->radius = radius;
+}
+
+// stride is the distance between consecutive points, counted in floats
+Bounds computeBounds(const float *positions, int count, int stride) {
+    Bounds b = {0};
+    if (!positions || count <= 0) {
+        return b;
+    }
+    computeAABB(&b, positions, count, stride);
+    computeSphere(&b, positions, count, stride);
+    return b;
+}
+
+Bounds mergeBounds(Bounds a, Bounds b) {
+    // Empty bounds have no radius
+    if (a.radius <= 0.0f) return b;
+    if (b.radius <= 0.0f) return a;
+
+    Bounds result;
+    for (int k = 0; k < 3; k++) {
+        result.min[k] = a.min[k] < b.min[k] ? a.min[k] : b.min[k];
+        result.max[k] = a.max[k] > b.max[k] ? a.max[k] : b.max[k];
+    }
+
+    float dist = sqrtf(distanceSq(a.center, b.center));
+    if (dist + b.radius <= a.radius) {
+        result.radius = a.radius;
+        for (int k = 0; k < 3; k++) result.center[k] = a.center[k];
+    }
+    else if (dist + a.radius <= b.radius) {
+        result.radius = b.radius;
+        for (int k = 0; k < 3; k++) result.center[k] = b.center[k];
+    }
+    else {
+        result.radius = (dist + a.radius + b.radius) * 0.5f;
+        float k = (result.radius - a.radius) / dist;
+        for (int j = 0; j < 3; j++) {
+            result.center[j] = a.center[j] + (b.center[j] - a.center[j]) * k;
+        }
+    }
+    return result;
+}
+
+// Box around the eight transformed corners, sphere scaled by the largest axis
+Bounds transformBounds(Bounds local, const Mat4x4 *model) {
+    if (local.radius <= 0.0f)
+        return local;
+
+    // The corners fill one batch of the SoA transform, the sphere center rides along as the ninth point
+    float x[9], y[9], z[9];
+    for (int c = 0; c < 8; c++) {
+        x[c] = c & 1 ? local.max[0] : local.min[0];
+        y[c] = c & 2 ? local.max[1] : local.min[1];
+        z[c] = c & 4 ? local.max[2] : local.min[2];
+    }
+    x[8] = local.center[0];
+    y[8] = local.center[1];
+    z[8] = local.center[2];
+    transformPositionsSoA(x, y, z, model, x, y, z, 9);
+
+    Bounds world;
+    const float *axes[3] = {x, y, z};
+    float maxScale = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        world.min[i] = world.max[i] = axes[i][0];
+        for (int c = 1; c < 8; c++) {
+            if (axes[i][c] < world.min[i]) world.min[i] = axes[i][c];
+            if (axes[i][c] > world.max[i]) world.max[i] = axes[i][c];
+        }
+        world.center[i] = axes[i][8];
+        const float *axis = model->m[i];
+        float scale = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if (scale > maxScale) maxScale = scale;
+    }
+    world.radius = local.radius * sqrtf(maxScale);
+    return world;
+}
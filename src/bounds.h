@@ -0,0 +1,16 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "math3d.h"
+
+typedef struct bounds {
+    float min[3], max[3];   // Axis aligned bounding box
+    float center[3];        // Bounding sphere
+    float radius;
+} Bounds;
+
+Bounds computeBounds(const float *positions, int count, int stride);
+Bounds mergeBounds(Bounds a, Bounds b);
+Bounds transformBounds(Bounds local, const Mat4x4 *model);
+
+#endif
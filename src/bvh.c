@@ -0,0 +1,406 @@
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+#include "bvh.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BVH_SSE
+#endif
+
+// Subtrees smaller than this are not worth a thread of their own
+#define PARALLEL_THRESHOLD 4096
+
+typedef struct buildNode {
+    float min[3], max[3];
+    struct buildNode *left, *right;     // NULL for leaves
+    int start, count;
+} BuildNode;
+
+typedef struct buildContext {
+    float *boxMin, *boxMax, *centroid;  // Three floats per triangle
+    int *order;
+    int parallelDepth;
+} BuildContext;
+
+typedef struct buildTask {
+    BuildContext *ctx;
+    BuildNode *node;
+    int start, count, depth;
+} BuildTask;
+
+typedef struct bin {
+    float min[3], max[3];
+    int count;
+} Bin;
+
+static void emptyBox(float *min, float *max) {
+    for (int k = 0; k < 3; k++) {
+        min[k] = FLT_MAX;
+        max[k] = -FLT_MAX;
+    }
+}
+
+static void growBox(float *min, float *max, const float *otherMin, const float *otherMax) {
+    for (int k = 0; k < 3; k++) {
+        if (otherMin[k] < min[k]) min[k] = otherMin[k];
+        if (otherMax[k] > max[k]) max[k] = otherMax[k];
+    }
+}
+
+static float surfaceArea(const float *min, const float *max) {
+    float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f) return 0.0f;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static void buildNode(BuildContext *ctx, BuildNode *node, int start, int count, int depth);
+
+static int buildTask(void *data) {
+    BuildTask *task = data;
+    buildNode(task->ctx, task->node, task->start, task->count, task->depth);
+    return 0;
+}
+
+// Binned SAH split of order[start, start + count)
+static void buildNode(BuildContext *ctx, BuildNode *node, int start, int count, int depth) {
+    float centroidMin[3], centroidMax[3];
+    emptyBox(node->min, node->max);
+    emptyBox(centroidMin, centroidMax);
+    for (int i = start; i < start + count; i++) {
+        int tri = ctx->order[i];
+        growBox(node->min, node->max, ctx->boxMin + tri * 3, ctx->boxMax + tri * 3);
+        growBox(centroidMin, centroidMax, ctx->centroid + tri * 3, ctx->centroid + tri * 3);
+    }
+    node->left = node->right = NULL;
+    node->start = start;
+    node->count = count;
+    if (count <= BVH_LEAF_SIZE) return;
+
+    // Bin along all three axes in a single pass over the triangles
+    Bin bins[3][BVH_BINS];
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        scale[axis] = extent > 0.0f ? BVH_BINS / extent : 0.0f;
+        for (int b = 0; b < BVH_BINS; b++) {
+            emptyBox(bins[axis][b].min, bins[axis][b].max);
+            bins[axis][b].count = 0;
+        }
+    }
+    for (int i = start; i < start + count; i++) {
+        int tri = ctx->order[i];
+        const float *min = ctx->boxMin + tri * 3, *max = ctx->boxMax + tri * 3;
+        for (int axis = 0; axis < 3; axis++) {
+            int b = (int)((ctx->centroid[tri * 3 + axis] - centroidMin[axis]) * scale[axis]);
+            if (b >= BVH_BINS) b = BVH_BINS - 1;
+            growBox(bins[axis][b].min, bins[axis][b].max, min, max);
+            bins[axis][b].count++;
+        }
+    }
+
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+        if (scale[axis] == 0.0f) continue;
+
+        // Sweep from the right, then evaluate each split while sweeping from the left
+        float rightArea[BVH_BINS];
+        int rightCount[BVH_BINS];
+        float min[3], max[3];
+        int n = 0;
+        emptyBox(min, max);
+        for (int b = BVH_BINS - 1; b > 0; b--) {
+            growBox(min, max, bins[axis][b].min, bins[axis][b].max);
+            n += bins[axis][b].count;
+            rightArea[b] = surfaceArea(min, max);
+            rightCount[b] = n;
+        }
+        emptyBox(min, max);
+        n = 0;
+        for (int b = 1; b < BVH_BINS; b++) {
+            growBox(min, max, bins[axis][b - 1].min, bins[axis][b - 1].max);
+            n += bins[axis][b - 1].count;
+            float cost = n * surfaceArea(min, max) + rightCount[b] * rightArea[b];
+            if (n > 0 && rightCount[b] > 0 && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    float leafCost = count * surfaceArea(node->min, node->max);
+    if (bestCost >= leafCost && count <= BVH_MAX_LEAF) return;
+
+    int mid = count / 2;
+    if (bestAxis >= 0) {
+        int i = start, j = start + count - 1;
+        while (i <= j) {
+            int tri = ctx->order[i];
+            int b = (int)((ctx->centroid[tri * 3 + bestAxis] - centroidMin[bestAxis]) * scale[bestAxis]);
+            if (b >= BVH_BINS) b = BVH_BINS - 1;
+            if (b < bestSplit) {
+                i++;
+            }
+            else {
+                ctx->order[i] = ctx->order[j];
+                ctx->order[j--] = tri;
+            }
+        }
+        if (i > start && i < start + count) mid = i - start;
+    }
+
+    node->left = malloc(sizeof(BuildNode));
+    node->right = malloc(sizeof(BuildNode));
+
+    if (depth < ctx->parallelDepth && count > PARALLEL_THRESHOLD) {
+        BuildTask task = {ctx, node->left, start, mid, depth + 1};
+        SDL_Thread *thread = SDL_CreateThread(buildTask, "bvh", &task);
+        buildNode(ctx, node->right, start + mid, count - mid, depth + 1);
+        if (thread) {
+            SDL_WaitThread(thread, NULL);
+        }
+        else {
+            buildTask(&task);
+        }
+    }
+    else {
+        buildNode(ctx, node->left, start, mid, depth + 1);
+        buildNode(ctx, node->right, start + mid, count - mid, depth + 1);
+    }
+}
+
+static void freeBuildNode(BuildNode *node) {
+    if (node->left) {
+        freeBuildNode(node->left);
+        freeBuildNode(node->right);
+        free(node->left);
+        free(node->right);
+    }
+}
+
+// Collapses the binary tree into 4-wide nodes by repeatedly opening the largest child
+static int flattenNode(BVH *bvh, const BuildNode *node, int depth) {
+    if (depth > bvh->depth) bvh->depth = depth;
+    const BuildNode *children[BVH_WIDTH];
+    int n = 0;
+    if (node->left) {
+        children[n++] = node->left;
+        children[n++] = node->right;
+        while (n < BVH_WIDTH) {
+            int open = -1;
+            float largest = -1.0f;
+            for (int k = 0; k < n; k++) {
+                float area = surfaceArea(children[k]->min, children[k]->max);
+                if (children[k]->left && area > largest) {
+                    largest = area;
+                    open = k;
+                }
+            }
+            if (open < 0) break;
+            const BuildNode *opened = children[open];
+            children[open] = opened->left;
+            children[n++] = opened->right;
+        }
+    }
+    else {
+        children[n++] = node;
+    }
+
+    if (bvh->nodeCount == bvh->nodeCapacity) {
+        bvh->nodeCapacity = bvh->nodeCapacity ? bvh->nodeCapacity * 2 : 64;
+        bvh->nodes = realloc(bvh->nodes, bvh->nodeCapacity * sizeof(BVHNode));
+    }
+    int index = bvh->nodeCount++;
+
+    for (int k = 0; k < BVH_WIDTH; k++) {
+        BVHNode *out = &bvh->nodes[index];
+        if (k >= n) {
+            out->minX[k] = out->minY[k] = out->minZ[k] = FLT_MAX;
+            out->maxX[k] = out->maxY[k] = out->maxZ[k] = -FLT_MAX;
+            out->child[k] = -1;
+            out->count[k] = 0;
+            continue;
+        }
+        const BuildNode *c = children[k];
+        out->minX[k] = c->min[0]; out->minY[k] = c->min[1]; out->minZ[k] = c->min[2];
+        out->maxX[k] = c->max[0]; out->maxY[k] = c->max[1]; out->maxZ[k] = c->max[2];
+        if (c->left) {
+            out->count[k] = 0;
+            int child = flattenNode(bvh, c, depth + 1);
+            bvh->nodes[index].child[k] = child;
+        }
+        else {
+            out->child[k] = c->start;
+            out->count[k] = c->count;
+        }
+    }
+    return index;
+}
+
+// stride is the distance between consecutive positions, counted in floats
+BVH *buildBVH(const float *positions, int stride, const unsigned int *indices, int indexCount) {
+    Uint64 startTime = SDL_GetPerformanceCounter();
+    BVH *bvh = calloc(1, sizeof(BVH));
+    int triangleCount = indexCount / 3;
+    if (!positions || triangleCount == 0) return bvh;
+
+    BuildContext ctx;
+    ctx.boxMin = malloc(triangleCount * 3 * sizeof(float));
+    ctx.boxMax = malloc(triangleCount * 3 * sizeof(float));
+    ctx.centroid = malloc(triangleCount * 3 * sizeof(float));
+    ctx.order = malloc(triangleCount * sizeof(int));
+    ctx.parallelDepth = 0;
+    for (int cpus = SDL_GetCPUCount(); cpus > 1; cpus = (cpus + 1) / 2) {
+        ctx.parallelDepth++;
+    }
+
+    for (int t = 0; t < triangleCount; t++) {
+        emptyBox(ctx.boxMin + t * 3, ctx.boxMax + t * 3);
+        for (int k = 0; k < 3; k++) {
+            const float *p = positions + (long)indices[t * 3 + k] * stride;
+            growBox(ctx.boxMin + t * 3, ctx.boxMax + t * 3, p, p);
+        }
+        for (int k = 0; k < 3; k++) {
+            ctx.centroid[t * 3 + k] = (ctx.boxMin[t * 3 + k] + ctx.boxMax[t * 3 + k]) * 0.5f;
+        }
+        ctx.order[t] = t;
+    }
+
+    BuildNode root;
+    buildNode(&ctx, &root, 0, triangleCount, 0);
+    flattenNode(bvh, &root, 1);
+    freeBuildNode(&root);
+
+    bvh->triangleCount = triangleCount;
+    bvh->triangles = malloc(triangleCount * 9 * sizeof(float));
+    bvh->triangleIds = ctx.order;
+    for (int i = 0; i < triangleCount; i++) {
+        int tri = ctx.order[i];
+        for (int k = 0; k < 3; k++) {
+            const float *p = positions + (long)indices[tri * 3 + k] * stride;
+            memcpy(bvh->triangles + i * 9 + k * 3, p, 3 * sizeof(float));
+        }
+    }
+
+    free(ctx.boxMin);
+    free(ctx.boxMax);
+    free(ctx.centroid);
+
+    bvh->buildTime = (SDL_GetPerformanceCounter() - startTime) * 1000.0f / SDL_GetPerformanceFrequency();
+    return bvh;
+}
+
+// Moller-Trumbore
+static int intersectTriangle(const float *tri, const float *origin, const float *dir, float *t, float *u, float *v) {
+    float e1[3] = {tri[3] - tri[0], tri[4] - tri[1], tri[5] - tri[2]};
+    float e2[3] = {tri[6] - tri[0], tri[7] - tri[1], tri[8] - tri[2]};
+    float p[3] = {dir[1] * e2[2] - dir[2] * e2[1], dir[2] * e2[0] - dir[0] * e2[2], dir[0] * e2[1] - dir[1] * e2[0]};
+    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (fabsf(det) < 1e-12f) return 0;
+
+    float inv = 1.0f / det;
+    float s[3] = {origin[0] - tri[0], origin[1] - tri[1], origin[2] - tri[2]};
+    *u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (*u < 0.0f || *u > 1.0f) return 0;
+
+    float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+    *v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv;
+    if (*v < 0.0f || *u + *v > 1.0f) return 0;
+
+    *t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+    return *t > 0.0f;
+}
+
+// Distances to the four child boxes of node, FLT_MAX where the ray misses
+static void intersectChildren(const BVHNode *node, const float *origin, const float *invDir, float tMax, float *dist) {
+#ifdef BVH_SSE
+    __m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+    __m128 ix = _mm_set1_ps(invDir[0]), iy = _mm_set1_ps(invDir[1]), iz = _mm_set1_ps(invDir[2]);
+    __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->minX), ox), ix);
+    __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->maxX), ox), ix);
+    __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->minY), oy), iy);
+    __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->maxY), oy), iy);
+    __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->minZ), oz), iz);
+    __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->maxZ), oz), iz);
+    __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+    __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(tMax)));
+    __m128 hit = _mm_cmple_ps(tNear, tFar);
+    _mm_storeu_ps(dist, _mm_or_ps(_mm_and_ps(hit, tNear), _mm_andnot_ps(hit, _mm_set1_ps(FLT_MAX))));
+#else
+    for (int k = 0; k < BVH_WIDTH; k++) {
+        float x0 = (node->minX[k] - origin[0]) * invDir[0], x1 = (node->maxX[k] - origin[0]) * invDir[0];
+        float y0 = (node->minY[k] - origin[1]) * invDir[1], y1 = (node->maxY[k] - origin[1]) * invDir[1];
+        float z0 = (node->minZ[k] - origin[2]) * invDir[2], z1 = (node->maxZ[k] - origin[2]) * invDir[2];
+        float tNear = fmaxf(fmaxf(fminf(x0, x1), fminf(y0, y1)), fmaxf(fminf(z0, z1), 0.0f));
+        float tFar = fminf(fminf(fmaxf(x0, x1), fmaxf(y0, y1)), fminf(fmaxf(z0, z1), tMax));
+        dist[k] = tNear <= tFar ? tNear : FLT_MAX;
+    }
+#endif
+}
+
+// Closest hit along origin + t * dir for t in (0, tMax). Returns 1 and fills hit on a hit.
+int intersectBVH(const BVH *bvh, const float *origin, const float *dir, float tMax, BVHHit *hit) {
+    if (!bvh || bvh->nodeCount == 0) return 0;
+
+    float invDir[3];
+    for (int k = 0; k < 3; k++) {
+        invDir[k] = fabsf(dir[k]) > 1e-20f ? 1.0f / dir[k] : copysignf(1e30f, dir[k]);
+    }
+
+    // Each level leaves at most BVH_WIDTH - 1 siblings waiting, the SAH split does not bound the depth
+    int stackBuffer[BVH_STACK_SIZE];
+    int stackSize = bvh->depth * (BVH_WIDTH - 1) + 1;
+    int *stack = stackSize <= BVH_STACK_SIZE ? stackBuffer : malloc(stackSize * sizeof(int));
+    int sp = 0;
+    stack[sp++] = 0;
+    int found = 0;
+
+    while (sp > 0) {
+        const BVHNode *node = &bvh->nodes[stack[--sp]];
+        float dist[BVH_WIDTH];
+        intersectChildren(node, origin, invDir, tMax, dist);
+
+        // Inner children are pushed furthest first so the nearest is visited next
+        int order[BVH_WIDTH], n = 0;
+        for (int k = 0; k < BVH_WIDTH; k++) {
+            if (dist[k] == FLT_MAX || node->child[k] < 0) continue;
+            if (node->count[k] > 0) {
+                for (int i = node->child[k]; i < node->child[k] + node->count[k]; i++) {
+                    float t, u, v;
+                    if (intersectTriangle(bvh->triangles + i * 9, origin, dir, &t, &u, &v) && t < tMax) {
+                        tMax = t;
+                        hit->t = t;
+                        hit->u = u;
+                        hit->v = v;
+                        hit->triangle = bvh->triangleIds[i];
+                        found = 1;
+                    }
+                }
+                continue;
+            }
+            int j = n++;
+            while (j > 0 && dist[order[j - 1]] < dist[k]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = k;
+        }
+        for (int i = 0; i < n; i++) {
+            stack[sp++] = node->child[order[i]];
+        }
+    }
+    if (stack != stackBuffer) free(stack);
+    return found;
+}
+
+void destroyBVH(BVH *bvh) {
+    if (!bvh) return;
+    free(bvh->nodes);
+    free(bvh->triangles);
+    free(bvh->triangleIds);
+    free(bvh);
+}
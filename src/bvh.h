@@ -0,0 +1,39 @@
+#ifndef BVH_H
+#define BVH_H
+
+#define BVH_WIDTH       4
+#define BVH_BINS        12
+#define BVH_LEAF_SIZE   4
+#define BVH_MAX_LEAF    16
+#define BVH_STACK_SIZE  64      // Traversal stack kept on the call stack, deeper trees use the heap
+
+// Four child boxes stored axis by axis so a ray is tested against all of them at once.
+// count > 0 marks a leaf holding count triangles starting at child, count == 0 an
+// inner node, and child < 0 an unused slot.
+typedef struct bvhNode {
+    float minX[BVH_WIDTH], minY[BVH_WIDTH], minZ[BVH_WIDTH];
+    float maxX[BVH_WIDTH], maxY[BVH_WIDTH], maxZ[BVH_WIDTH];
+    int child[BVH_WIDTH];
+    int count[BVH_WIDTH];
+} BVHNode;
+
+typedef struct bvh {
+    BVHNode *nodes;
+    int nodeCount, nodeCapacity;
+    int depth;              // Levels of nodes, the root alone is one
+    float *triangles;       // v0, v1, v2 of every triangle in traversal order
+    int *triangleIds;       // Original triangle index for each entry of triangles
+    int triangleCount;
+    float buildTime;        // Milliseconds
+} BVH;
+
+typedef struct bvhHit {
+    float t, u, v;
+    int triangle;
+} BVHHit;
+
+BVH *buildBVH(const float *positions, int stride, const unsigned int *indices, int indexCount);
+int intersectBVH(const BVH *bvh, const float *origin, const float *dir, float tMax, BVHHit *hit);
+void destroyBVH(BVH *bvh);
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_image.h>
+#include "capture.h"
+#include "glstats.h"
+#include "trace.h"
+
+static int captureWriter(void *data) {
+    Capture *cap = data;
+    nameTraceThread("PNG writer");
+    for (;;) {
+        SDL_SemWait(cap->filled);
+        if (cap->quit) break;
+
+        const char *path = cap->imagePaths[cap->tail];
+        TraceZone zone = beginZone("write PNG");
+        if (IMG_SavePNG(cap->images[cap->tail], path) != 0)
+            printf("Failed to write %s: %s\n", path, IMG_GetError());
+        endZone(zone);
+
+        cap->tail = (cap->tail + 1) % CAPTURE_IMAGES;
+        SDL_SemPost(cap->free);
+    }
+    return 0;
+}
+
+Capture *createCapture(int width, int height, const char *prefix) {
+    Capture *cap = calloc(1, sizeof(Capture));
+    cap->width = width;
+    cap->height = height;
+    snprintf(cap->prefix, sizeof(cap->prefix), "%s", prefix);
+
+    glGenBuffers(CAPTURE_PBOS, cap->PBO);
+    for (int i = 0; i < CAPTURE_PBOS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->PBO[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (int i = 0; i < CAPTURE_IMAGES; i++) {
+        cap->images[i] = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    }
+    cap->filled = SDL_CreateSemaphore(0);
+    cap->free = SDL_CreateSemaphore(CAPTURE_IMAGES);
+    cap->writer = SDL_CreateThread(captureWriter, "capture", cap);
+    return cap;
+}
+
+// Maps the oldest read, flips it into a free image and hands that to the writer
+static void resolveOldest(Capture *cap) {
+    int slot = (cap->next - cap->pending + CAPTURE_PBOS) % CAPTURE_PBOS;
+    GLenum status = glClientWaitSync(cap->fences[slot], 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        cap->fenceStalls++;
+        do {
+            status = glClientWaitSync(cap->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(cap->fences[slot]);
+    cap->fences[slot] = NULL;
+
+    if (SDL_SemTryWait(cap->free) != 0) {
+        cap->writerStalls++;
+        SDL_SemWait(cap->free);
+    }
+    SDL_Surface *image = cap->images[cap->head];
+
+    int rowBytes = cap->width * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->PBO[slot]);
+    const unsigned char *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)rowBytes * cap->height, GL_MAP_READ_BIT);
+    if (pixels) {
+        // GL rows start at the bottom
+        for (int y = 0; y < cap->height; y++) {
+            memcpy((unsigned char*)image->pixels + (size_t)y * image->pitch,
+                   pixels + (size_t)(cap->height - 1 - y) * rowBytes, rowBytes);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glStats.bufferBinds += 2;
+
+    memcpy(cap->imagePaths[cap->head], cap->pboPaths[slot], CAPTURE_PATH);
+    cap->head = (cap->head + 1) % CAPTURE_IMAGES;
+    cap->pending--;
+    cap->captured++;
+    SDL_SemPost(cap->filled);
+}
+
+// Starts the readback of the frame just rendered into <prefix>NNNN.png
+void captureFrame(Capture *cap, int frame) {
+    char path[CAPTURE_PATH];
+    if (snprintf(path, sizeof(path), "%s%04d.png", cap->prefix, frame) >= (int)sizeof(path)) {
+        printf("Capture path %s%04d.png is too long, frame skipped\n", cap->prefix, frame);
+        return;
+    }
+    captureFrameAs(cap, path);
+}
+
+// Starts the readback of the frame just rendered into the next PBO
+void captureFrameAs(Capture *cap, const char *path) {
+    if (cap->pending == CAPTURE_PBOS)
+        resolveOldest(cap);
+
+    int slot = cap->next;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->PBO[slot]);
+    glReadPixels(0, 0, cap->width, cap->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glStats.bufferBinds += 2;
+    cap->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    snprintf(cap->pboPaths[slot], CAPTURE_PATH, "%s", path);
+    cap->next = (slot + 1) % CAPTURE_PBOS;
+    cap->pending++;
+}
+
+// Hands every read still in flight to the writer
+void flushCapture(Capture *cap) {
+    while (cap->pending > 0) {
+        resolveOldest(cap);
+    }
+}
+
+void destroyCapture(Capture *cap) {
+    flushCapture(cap);
+    // Every image back in the free pool means the writer has saved them all
+    for (int i = 0; i < CAPTURE_IMAGES; i++) {
+        SDL_SemWait(cap->free);
+    }
+    cap->quit = 1;
+    SDL_SemPost(cap->filled);
+    SDL_WaitThread(cap->writer, NULL);
+
+    glDeleteBuffers(CAPTURE_PBOS, cap->PBO);
+    for (int i = 0; i < CAPTURE_IMAGES; i++) {
+        SDL_FreeSurface(cap->images[i]);
+    }
+    SDL_DestroySemaphore(cap->filled);
+    SDL_DestroySemaphore(cap->free);
+    free(cap);
+}
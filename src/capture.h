@@ -0,0 +1,40 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#define CAPTURE_PBOS    3   // Frame N is mapped while N+1 and N+2 are rendered
+#define CAPTURE_IMAGES  4   // Frames waiting for the PNG writer
+#define CAPTURE_PATH    512
+
+// Frame capture without stalling the pipeline: glReadPixels goes into a ring of
+// pixel buffer objects, each fenced and only mapped once the GPU is past it,
+// and the PNG encoding happens on a writer thread.
+typedef struct capture {
+    int width, height;
+    unsigned int PBO[CAPTURE_PBOS];
+    GLsync fences[CAPTURE_PBOS];
+    char pboPaths[CAPTURE_PBOS][CAPTURE_PATH];
+    int next, pending;              // Next PBO to read into, reads still in flight
+
+    SDL_Surface *images[CAPTURE_IMAGES];
+    char imagePaths[CAPTURE_IMAGES][CAPTURE_PATH];
+    int head, tail;                 // Filled by the render thread, emptied by the writer
+    SDL_sem *filled, *free;
+    SDL_Thread *writer;
+    char prefix[CAPTURE_PATH];
+    int quit;
+
+    int captured;
+    int fenceStalls;                // Reads that were not done by the time they were mapped
+    int writerStalls;               // Frames that waited for the writer to free an image
+} Capture;
+
+Capture *createCapture(int width, int height, const char *prefix);
+void captureFrame(Capture *cap, int frame);
+void captureFrameAs(Capture *cap, const char *path);
+void flushCapture(Capture *cap);
+void destroyCapture(Capture *cap);
+
+#endif
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cull.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULL_WIDTH 4
+#else
+#define CULL_WIDTH 1
+#endif
+
+// Matrices are stored column by column (as uploaded to GL), so the product
+// projection * view * model is built right to left.
+void clipMatrix(Mat4x4 *result, const Mat4x4 *model, const Mat4x4 *view, const Mat4x4 *projection) {
+    multiplyMatricesPtr(result, model, view);
+    multiplyMatricesPtr(result, result, projection);
+}
+
+// Gribb/Hartmann plane extraction from the rows of the clip matrix
+void extractFrustum(Frustum *frustum, const Mat4x4 *clip) {
+    for (int i = 0; i < 3; i++) {
+        for (int c = 0; c < 4; c++) {
+            frustum->planes[i * 2][c]     = clip->m[c][3] + clip->m[c][i];
+            frustum->planes[i * 2 + 1][c] = clip->m[c][3] - clip->m[c][i];
+        }
+    }
+
+    for (int p = 0; p < 6; p++) {
+        float *plane = frustum->planes[p];
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (int c = 0; c < 4; c++) plane[c] /= length;
+        }
+    }
+}
+
+static void resizeCullSet(CullSet *set, int capacity) {
+    // Keep room for a whole SIMD batch past the last box
+    capacity = (capacity + 7) & ~7;
+    float **arrays[6] = {&set->centerX, &set->centerY, &set->centerZ, &set->extentX, &set->extentY, &set->extentZ};
+    for (int i = 0; i < 6; i++) {
+        *arrays[i] = realloc(*arrays[i], capacity * sizeof(float));
+        memset(*arrays[i] + set->capacity, 0, (capacity - set->capacity) * sizeof(float));
+    }
+    set->visible = realloc(set->visible, capacity);
+    memset(set->visible + set->capacity, 0, capacity - set->capacity);
+    set->capacity = capacity;
+}
+
+CullSet createCullSet(int capacity) {
+    CullSet set = {0};
+    resizeCullSet(&set, capacity > 0 ? capacity : 8);
+    return set;
+}
+
+void setCullBounds(CullSet *set, int index, Bounds bounds) {
+    set->centerX[index] = (bounds.min[0] + bounds.max[0]) * 0.5f;
+    set->centerY[index] = (bounds.min[1] + bounds.max[1]) * 0.5f;
+    set->centerZ[index] = (bounds.min[2] + bounds.max[2]) * 0.5f;
+    set->extentX[index] = (bounds.max[0] - bounds.min[0]) * 0.5f;
+    set->extentY[index] = (bounds.max[1] - bounds.min[1]) * 0.5f;
+    set->extentZ[index] = (bounds.max[2] - bounds.min[2]) * 0.5f;
+}
+
+int addCullBounds(CullSet *set, Bounds bounds) {
+    if (set->count == set->capacity) {
+        resizeCullSet(set, set->capacity * 2);
+    }
+    setCullBounds(set, set->count, bounds);
+    set->visible[set->count] = 1;
+    return set->count++;
+}
+
+// A box is outside when it lies entirely behind any one of the six planes
+int cullFrustum(CullSet *set, const Frustum *frustum) {
+    int visibleCount = 0;
+    int i = 0;
+
+#if CULL_WIDTH == 8
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (; i < set->count; i += 8) {
+        __m256 cx = _mm256_loadu_ps(set->centerX + i), cy = _mm256_loadu_ps(set->centerY + i), cz = _mm256_loadu_ps(set->centerZ + i);
+        __m256 ex = _mm256_loadu_ps(set->extentX + i), ey = _mm256_loadu_ps(set->extentY + i), ez = _mm256_loadu_ps(set->extentZ + i);
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            const float *plane = frustum->planes[p];
+            __m256 a = _mm256_set1_ps(plane[0]), b = _mm256_set1_ps(plane[1]), c = _mm256_set1_ps(plane[2]);
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)),
+                                        _mm256_add_ps(_mm256_mul_ps(c, cz), _mm256_set1_ps(plane[3])));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, a), ex),
+                                                        _mm256_mul_ps(_mm256_andnot_ps(signMask, b), ey)),
+                                          _mm256_mul_ps(_mm256_andnot_ps(signMask, c), ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        int mask = _mm256_movemask_ps(outside);
+        for (int k = 0; k < 8; k++) {
+            set->visible[i + k] = !(mask & (1 << k));
+        }
+    }
+#elif CULL_WIDTH == 4
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (; i < set->count; i += 4) {
+        __m128 cx = _mm_loadu_ps(set->centerX + i), cy = _mm_loadu_ps(set->centerY + i), cz = _mm_loadu_ps(set->centerZ + i);
+        __m128 ex = _mm_loadu_ps(set->extentX + i), ey = _mm_loadu_ps(set->extentY + i), ez = _mm_loadu_ps(set->extentZ + i);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            const float *plane = frustum->planes[p];
+            __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]);
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+                                     _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(plane[3])));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex),
+                                                  _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++) {
+            set->visible[i + k] = !(mask & (1 << k));
+        }
+    }
+#else
+    for (; i < set->count; i++) {
+        int inside = 1;
+        for (int p = 0; p < 6 && inside; p++) {
+            const float *plane = frustum->planes[p];
+            float dist = plane[0] * set->centerX[i] + plane[1] * set->centerY[i] + plane[2] * set->centerZ[i] + plane[3];
+            float radius = fabsf(plane[0]) * set->extentX[i] + fabsf(plane[1]) * set->extentY[i] + fabsf(plane[2]) * set->extentZ[i];
+            inside = dist + radius >= 0.0f;
+        }
+        set->visible[i] = inside;
+    }
+#endif
+
+    for (i = 0; i < set->count; i++) {
+        visibleCount += set->visible[i];
+    }
+    set->visibleCount = visibleCount;
+    return visibleCount;
+}
+
+void destroyCullSet(CullSet *set) {
+    free(set->centerX);
+    free(set->centerY);
+    free(set->centerZ);
+    free(set->extentX);
+    free(set->extentY);
+    free(set->extentZ);
+    free(set->visible);
+    memset(set, 0, sizeof(*set));
+}
@@ -0,0 +1,29 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include "math3d.h"
+#include "bounds.h"
+
+typedef struct frustum {
+    float planes[6][4];     // a, b, c, d with the normal pointing inwards
+} Frustum;
+
+// Bounding boxes stored as separate arrays so they can be tested several at a time
+typedef struct cullSet {
+    float *centerX, *centerY, *centerZ;
+    float *extentX, *extentY, *extentZ;
+    unsigned char *visible;
+    int count, capacity;
+    int visibleCount;
+} CullSet;
+
+void extractFrustum(Frustum *frustum, const Mat4x4 *clip);
+void clipMatrix(Mat4x4 *result, const Mat4x4 *model, const Mat4x4 *view, const Mat4x4 *projection);
+
+CullSet createCullSet(int capacity);
+int addCullBounds(CullSet *set, Bounds bounds);
+void setCullBounds(CullSet *set, int index, Bounds bounds);
+int cullFrustum(CullSet *set, const Frustum *frustum);
+void destroyCullSet(CullSet *set);
+
+#endif
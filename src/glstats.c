@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <string.h>
+#include "glstats.h"
+
+GLStats glStats;
+
+void resetGLStats(void) {
+    int setupUniformCalls = glStats.setupUniformCalls;
+    memset(&glStats, 0, sizeof(glStats));
+    glStats.setupUniformCalls = setupUniformCalls;
+}
+
+int totalGLCalls(const GLStats *stats) {
+    return stats->programBinds + stats->bufferWrites + stats->bufferBinds + stats->vertexArrayBinds + stats->drawCalls +
+           stats->uniformCalls;
+}
+
+void printGLStats(const GLStats *stats) {
+    printf("GL calls: %d (%d program binds, %d buffer writes, %d buffer binds, %d VAO binds, %d draws, "
+           "%d uniform, %d uniform at setup)\n",
+           totalGLCalls(stats), stats->programBinds, stats->bufferWrites, stats->bufferBinds,
+           stats->vertexArrayBinds, stats->drawCalls, stats->uniformCalls, stats->setupUniformCalls);
+}
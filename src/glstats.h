@@ -0,0 +1,22 @@
+#ifndef GLSTATS_H
+#define GLSTATS_H
+
+// GL calls issued by the viewer, counted on the CPU side so the numbers hold
+// under any driver, software ones included
+typedef struct glStats {
+    int programBinds;
+    int bufferWrites;
+    int bufferBinds;
+    int vertexArrayBinds;
+    int drawCalls;
+    int uniformCalls;           // glUniform* and glUniformBlockBinding, per frame values all live in uniform buffers
+    int setupUniformCalls;      // The same issued while linking shaders, kept across resets
+} GLStats;
+
+extern GLStats glStats;
+
+void resetGLStats(void);
+int totalGLCalls(const GLStats *stats);
+void printGLStats(const GLStats *stats);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "headless.h"
+
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// Mesa's surfaceless platform needs neither an X nor a Wayland server
+static EGLDisplay openDisplay(void) {
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+        return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static int createContext(Headless *hl) {
+    EGLDisplay display = openDisplay();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        printf("Failed to open an EGL display: 0x%x\n", eglGetError());
+        return 0;
+    }
+    if (!strstr(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        printf("EGL display has no surfaceless contexts\n");
+        eglTerminate(display);
+        return 0;
+    }
+
+    // Surface type 0 matches any config, no surface is ever created
+    EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    eglBindAPI(EGL_OPENGL_API);
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("No EGL config for desktop OpenGL\n");
+        eglTerminate(display);
+        return 0;
+    }
+
+    // Same version and profile the windowed path asks SDL for
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        printf("Failed to create an EGL context: 0x%x\n", eglGetError());
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        return 0;
+    }
+
+    hl->display = display;
+    hl->context = context;
+    return 1;
+}
+
+static void destroyContext(Headless *hl) {
+    eglMakeCurrent(hl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(hl->display, hl->context);
+    eglTerminate(hl->display);
+}
+#else
+static int createContext(Headless *hl) {
+    (void)hl;
+    printf("Headless rendering needs a build with EGL, see the Makefile\n");
+    return 0;
+}
+
+static void destroyContext(Headless *hl) {
+    (void)hl;
+}
+#endif
+
+int createHeadless(Headless *hl, int width, int height) {
+    memset(hl, 0, sizeof(*hl));
+    if (!createContext(hl))
+        return 0;
+
+    // A GLEW built for GLX finds no X display, but has loaded the GL entry points by then
+    glewExperimental = GL_TRUE;
+    GLenum error = glewInit();
+    if (error != GLEW_OK && error != GLEW_ERROR_NO_GLX_DISPLAY) {
+        printf("Failed to initialize GLEW: %s\n", glewGetErrorString(error));
+        destroyContext(hl);
+        return 0;
+    }
+
+    hl->width = width;
+    hl->height = height;
+    glGenRenderbuffers(1, &hl->colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, hl->colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &hl->depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, hl->depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &hl->FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, hl->FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, hl->colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, hl->depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Offscreen framebuffer is incomplete\n");
+        destroyHeadless(hl);
+        return 0;
+    }
+
+    // Without a surface nothing sets the viewport, and the FBO stays bound from here on
+    glViewport(0, 0, width, height);
+    return 1;
+}
+
+void destroyHeadless(Headless *hl) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &hl->FBO);
+    glDeleteRenderbuffers(1, &hl->colorBuffer);
+    glDeleteRenderbuffers(1, &hl->depthBuffer);
+    destroyContext(hl);
+}
@@ -0,0 +1,15 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Offscreen GL context with no window or display, rendering into a framebuffer object.
+// Needs a build with EGL (make HEADLESS=1), e.g. Mesa llvmpipe on a machine without a GPU.
+typedef struct headless {
+    void *display, *context;    // EGLDisplay and EGLContext
+    unsigned int FBO, colorBuffer, depthBuffer;
+    int width, height;
+} Headless;
+
+int createHeadless(Headless *hl, int width, int height);
+void destroyHeadless(Headless *hl);
+
+#endif
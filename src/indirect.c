@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <GL/glew.h>
+#include "indirect.h"
+#include "glstats.h"
+
+// Core in 4.3, also exposed as extensions by 3.3 drivers such as llvmpipe
+int indirectDrawsSupported(void) {
+    return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+IndirectDraws createIndirectDraws(const GeometryArena *arena, int capacity) {
+    IndirectDraws draws = {0};
+    draws.capacity = capacity;
+    draws.commands = malloc(capacity * sizeof(DrawCommand));
+    draws.objects = malloc(capacity * sizeof(InstanceData));
+
+    glGenBuffers(1, &draws.commandBuffer);
+    glGenBuffers(1, &draws.objectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draws.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity * sizeof(DrawCommand), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenVertexArrays(1, &draws.VAO);
+    glBindVertexArray(draws.VAO);
+    bindArenaAttributes(arena);
+    glBindBuffer(GL_ARRAY_BUFFER, draws.objectBuffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+    bindInstanceAttributes(draws.objectBuffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return draws;
+}
+
+// Writes one command per visible mesh and uploads commands and per-draw data.
+// Returns the number of commands.
+int buildIndirectDraws(IndirectDraws *draws, const Mesh *meshes, const unsigned char *visible, int meshCount) {
+    draws->count = 0;
+    for (int i = 0; i < meshCount && draws->count < draws->capacity; i++) {
+        if (!visible[i] || meshes[i].indiceCount == 0)
+            continue;
+        const Mesh *mesh = &meshes[i];
+        int n = draws->count++;
+        draws->commands[n] = (DrawCommand){
+            .count = mesh->indiceCount,
+            .instanceCount = 1,
+            .firstIndex = mesh->firstIndex,
+            .baseVertex = mesh->baseVertex,
+            .baseInstance = n
+        };
+        draws->objects[n].model = mesh->model;
+        draws->objects[n].color[0] = mesh->color[0];
+        draws->objects[n].color[1] = mesh->color[1];
+        draws->objects[n].color[2] = mesh->color[2];
+    }
+    if (draws->count == 0)
+        return 0;
+
+    // Orphaned first so the driver never waits on the previous frame's data
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draws->commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, draws->capacity * sizeof(DrawCommand), NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, draws->count * sizeof(DrawCommand), draws->commands);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, draws->objectBuffer);
+    glBufferData(GL_ARRAY_BUFFER, draws->capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, draws->count * sizeof(InstanceData), draws->objects);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glStats.bufferWrites += 2;
+    return draws->count;
+}
+
+// Draws with the instanced program and draws->VAO bound
+void submitIndirectDraws(const IndirectDraws *draws, int mode) {
+    if (draws->count == 0)
+        return;
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draws->commandBuffer);
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, 0, draws->count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glStats.bufferBinds += 2;
+    glStats.drawCalls++;
+}
+
+void destroyIndirectDraws(IndirectDraws *draws) {
+    glDeleteVertexArrays(1, &draws->VAO);
+    glDeleteBuffers(1, &draws->commandBuffer);
+    glDeleteBuffers(1, &draws->objectBuffer);
+    free(draws->commands);
+    free(draws->objects);
+}
@@ -0,0 +1,32 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include "mesh.h"
+#include "instance.h"
+
+// Layout glMultiDrawElementsIndirect reads
+typedef struct drawCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+} DrawCommand;
+
+// The visible meshes as one indirect submission. Each command draws a single
+// instance whose baseInstance selects its model and colour from objects.
+typedef struct indirectDraws {
+    unsigned int VAO;
+    unsigned int commandBuffer, objectBuffer;
+    DrawCommand *commands;
+    InstanceData *objects;
+    int count, capacity;
+} IndirectDraws;
+
+int indirectDrawsSupported(void);
+IndirectDraws createIndirectDraws(const GeometryArena *arena, int capacity);
+int buildIndirectDraws(IndirectDraws *draws, const Mesh *meshes, const unsigned char *visible, int meshCount);
+void submitIndirectDraws(const IndirectDraws *draws, int mode);
+void destroyIndirectDraws(IndirectDraws *draws);
+
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <GL/glew.h>
+#include "instance.h"
+#include "glstats.h"
+
+InstanceBatch createInstanceBatch(const Mesh *mesh, int capacity) {
+    InstanceBatch batch = {0};
+    batch.mesh = mesh;
+    batch.capacity = capacity;
+    batch.instances = malloc(capacity * sizeof(InstanceData));
+    batch.drawn = malloc(capacity * sizeof(InstanceData));
+    batch.drawnVisible = calloc(capacity, 1);
+    batch.cullSet = createCullSet(capacity);
+
+    // Own VAO reading the geometry arena plus the instance buffer
+    glGenVertexArrays(1, &batch.VAO);
+    glBindVertexArray(batch.VAO);
+    bindArenaAttributes(mesh->arena);
+
+    glGenBuffers(1, &batch.instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+    bindInstanceAttributes(batch.instanceVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    return batch;
+}
+
+// Points attributes 3-7 of the bound VAO at an InstanceData buffer, advancing once per instance
+void bindInstanceAttributes(unsigned int buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(offsetof(InstanceData, model) + i * 4 * sizeof(float)));
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribDivisor(3 + i, 1);
+    }
+    glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+    glEnableVertexAttribArray(7);
+    glVertexAttribDivisor(7, 1);
+}
+
+// Returns the instance index, or -1 when the batch is full
+int addInstance(InstanceBatch *batch, Transform transform, const float *color) {
+    if (batch->count == batch->capacity)
+        return -1;
+
+    InstanceData *instance = &batch->instances[batch->count];
+    transformToMatrix(&instance->model, &transform);
+    instance->color[0] = color[0];
+    instance->color[1] = color[1];
+    instance->color[2] = color[2];
+
+    Bounds bounds = transformBounds(batch->mesh->localBounds, &instance->model);
+    addCullBounds(&batch->cullSet, bounds);
+    batch->bounds = mergeBounds(batch->bounds, bounds);
+    batch->dirty = 1;
+    return batch->count++;
+}
+
+// Frustum culls every instance and re-uploads the visible ones, but only when the
+// visible set differs from what the GPU already has. Returns the visible count.
+int cullInstances(InstanceBatch *batch, const Frustum *frustum) {
+    cullFrustum(&batch->cullSet, frustum);
+    if (!batch->dirty && memcmp(batch->cullSet.visible, batch->drawnVisible, batch->count) == 0)
+        return batch->drawnCount;
+
+    batch->drawnCount = 0;
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->cullSet.visible[i])
+            batch->drawn[batch->drawnCount++] = batch->instances[i];
+    }
+    memcpy(batch->drawnVisible, batch->cullSet.visible, batch->count);
+    batch->dirty = 0;
+
+    // Orphan the old storage so the driver does not wait on frames still using it
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, batch->capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batch->drawnCount * sizeof(InstanceData), batch->drawn);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glStats.bufferWrites++;
+    return batch->drawnCount;
+}
+
+// Expects batch->VAO to be bound
+void drawInstances(const InstanceBatch *batch, int mode) {
+    if (batch->drawnCount == 0)
+        return;
+
+    const Mesh *mesh = batch->mesh;
+    glDrawElementsInstancedBaseVertex(mode, mesh->indiceCount, GL_UNSIGNED_INT,
+                                      (void*)((size_t)mesh->firstIndex * sizeof(unsigned int)),
+                                      batch->drawnCount, mesh->baseVertex);
+    glStats.drawCalls++;
+}
+
+void destroyInstanceBatch(InstanceBatch *batch) {
+    glDeleteVertexArrays(1, &batch->VAO);
+    glDeleteBuffers(1, &batch->instanceVBO);
+    destroyCullSet(&batch->cullSet);
+    free(batch->instances);
+    free(batch->drawn);
+    free(batch->drawnVisible);
+}
@@ -0,0 +1,35 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "mesh.h"
+#include "cull.h"
+
+// Per-instance vertex attributes, locations 3-6 for the model and 7 for the colour
+typedef struct instanceData {
+    Mat4x4 model;
+    float color[3];
+} InstanceData;
+
+// Copies of one mesh drawn with a single instanced call. Instances outside the
+// frustum are left out of the uploaded buffer.
+typedef struct instanceBatch {
+    const Mesh *mesh;
+    unsigned int VAO, instanceVBO;
+    InstanceData *instances;
+    InstanceData *drawn;            // Visible instances, as last uploaded
+    unsigned char *drawnVisible;    // Cull result drawn was built from
+    CullSet cullSet;
+    int count, capacity;
+    int drawnCount;
+    int dirty;                      // Instances changed since the last upload
+    Bounds bounds;
+} InstanceBatch;
+
+InstanceBatch createInstanceBatch(const Mesh *mesh, int capacity);
+void bindInstanceAttributes(unsigned int buffer);
+int addInstance(InstanceBatch *batch, Transform transform, const float *color);
+int cullInstances(InstanceBatch *batch, const Frustum *frustum);
+void drawInstances(const InstanceBatch *batch, int mode);
+void destroyInstanceBatch(InstanceBatch *batch);
+
+#endif
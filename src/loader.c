@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include "loader.h"
+#include "trace.h"
+
+static int loaderWorker(void *data) {
+    ModelLoader *loader = data;
+    nameTraceThread("loader");
+    for (;;) {
+        // Indices are claimed in order, so the model the caller waits for is always in progress
+        SDL_SemWait(loader->slots);
+        int i = SDL_AtomicAdd(&loader->next, 1);
+        if (i >= loader->count) break;
+
+        LoadedModel *model = &loader->models[i];
+        Uint64 start = SDL_GetPerformanceCounter();
+        model->mesh = loadOBJ(loader->paths[i], POS(0.0f, 0.0f, 0.0f), "yellow", 1.0f);
+        model->loadTime = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+        SDL_SemPost(model->done);
+    }
+    return 0;
+}
+
+ModelLoader *createModelLoader(char **paths, int count, int workerCount) {
+    ModelLoader *loader = calloc(1, sizeof(ModelLoader));
+    loader->paths = paths;
+    loader->count = count;
+    loader->models = calloc(count, sizeof(LoadedModel));
+    for (int i = 0; i < count; i++) {
+        loader->models[i].done = SDL_CreateSemaphore(0);
+    }
+
+    loader->workerCount = workerCount > 0 ? workerCount : 1;
+    loader->slots = SDL_CreateSemaphore(LOADER_AHEAD + 1);
+    loader->workers = calloc(loader->workerCount, sizeof(SDL_Thread *));
+    for (int i = 0; i < loader->workerCount; i++) {
+        loader->workers[i] = SDL_CreateThread(loaderWorker, "loader", loader);
+    }
+    return loader;
+}
+
+LoadedModel *waitForModel(ModelLoader *loader, int i) {
+    SDL_SemWait(loader->models[i].done);
+    return &loader->models[i];
+}
+
+// The caller is done with model i and has destroyed its mesh, a worker may start the next one
+void releaseModel(ModelLoader *loader, int i) {
+    loader->models[i].released = 1;
+    SDL_SemPost(loader->slots);
+}
+
+void destroyModelLoader(ModelLoader *loader) {
+    // Workers still waiting for a slot find nothing left to claim
+    SDL_AtomicSet(&loader->next, loader->count);
+    for (int i = 0; i < loader->workerCount; i++) {
+        SDL_SemPost(loader->slots);
+    }
+    for (int i = 0; i < loader->workerCount; i++) {
+        SDL_WaitThread(loader->workers[i], NULL);
+    }
+
+    for (int i = 0; i < loader->count; i++) {
+        LoadedModel *model = &loader->models[i];
+        if (!model->released && SDL_SemValue(model->done) > 0)
+            destroyMesh(&model->mesh);
+        SDL_DestroySemaphore(model->done);
+    }
+    SDL_DestroySemaphore(loader->slots);
+    free(loader->workers);
+    free(loader->models);
+    free(loader);
+}
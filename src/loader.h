@@ -0,0 +1,34 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <SDL2/SDL.h>
+#include "mesh.h"
+
+#define LOADER_AHEAD    2   // Models parsed ahead of the one in use, bounds the memory held
+
+typedef struct loadedModel {
+    Mesh mesh;
+    float loadTime;         // Milliseconds on the worker
+    int released;
+    SDL_sem *done;
+} LoadedModel;
+
+// Parses a list of OBJ files on worker threads, in list order, while the caller
+// works on earlier ones. Meshes come back without GL geometry, see uploadMesh().
+typedef struct modelLoader {
+    char **paths;
+    LoadedModel *models;
+    int count;
+
+    SDL_Thread **workers;
+    int workerCount;
+    SDL_atomic_t next;
+    SDL_sem *slots;
+} ModelLoader;
+
+ModelLoader *createModelLoader(char **paths, int count, int workerCount);
+LoadedModel *waitForModel(ModelLoader *loader, int i);
+void releaseModel(ModelLoader *loader, int i);
+void destroyModelLoader(ModelLoader *loader);
+
+#endif
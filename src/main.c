@@ -1,9 +1,31 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
 #include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
 #include <GL/glew.h>
 #include "shader.h"
 #include "mesh.h"
 #include "math3d.h"
+#include "cull.h"
+#include "occlusion.h"
+#include "pick.h"
+#include "transform.h"
+#include "ubo.h"
+#include "glstats.h"
+#include "instance.h"
+#include "indirect.h"
+#include "queue.h"
+#include "headless.h"
+#include "capture.h"
+#include "loader.h"
+#include "softrast.h"
+#include "profiler.h"
+#include "trace.h"
+#include "bench.h"
+
+#define IDLE_WAIT_MS 250      // Longest sleep between checks for changes that arrive without an event
 
 typedef struct eventHandler
 {
@@ -17,12 +39,20 @@ typedef struct eventHandler
     int mouseDown;
     int mouseMiddle;
     int shift;
+    int pick;
+    int pickX, pickY;
+    int multiDraw;
+    int capture;
+    int profile;
+    int writeTrace;
+    int dirty;              // Something changed since the last frame was drawn
 } EventH;
 
 typedef struct camera {
     Mat4x4 model, view, projection;
     Vertex eye, target, up;
-    float angleX, angleY, angleZ;
+    Quat orientation;
+    int modelDirty;         // Orientation changed, model needs rebuilding
 } Camera;
 
 typedef struct windowModel
@@ -31,112 +61,1144 @@ typedef struct windowModel
     SDL_GLContext glContext;
     EventH *eh;
     Camera *cam;
-    unsigned int shaderProgram;
+    ShaderProgram shader, instancedShader;
+    Profiler *profiler;     // NULL unless profiling
 } WindowModel;
 
-void render(unsigned int shaderProgram, EventH *eh, Mesh *mesh, int meshCount);
-void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX, float *angleY);
+float render(WindowModel *wm, UniformBuffers *ub, RenderQueue *queue, GeometryArena *arena, Mesh *mesh, int meshCount,
+             const unsigned char *visible, InstanceBatch *batch, IndirectDraws *indirect);
+float viewDepth(const Camera *cam, const float *p);
+void drawRenderQueue(const RenderQueue *queue, UniformBuffers *ub, int mode, Profiler *prof, const Mesh *meshes);
+Transform stressTransform(int i, int count, float *color);
+void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, Quat *orientation, int waitMs);
 void toggleFullscreen(WindowModel *wm);
 int initializeWindow(WindowModel *wm);
+int initializeHeadless(WindowModel *wm, Headless *hl);
+void fitCameraToBounds(Camera *cam, Bounds bounds);
+void flyBenchmarkPath(Camera *cam, Bounds bounds, float t);
+void pickUnderCursor(WindowModel *wm, Mesh *meshes, int meshCount);
+void stopCapture(Capture *capture);
+int runBatch(WindowModel *wm, const Headless *hl, const char *listFile, int angles, const char *outputPrefix);
+int runSoftBenchmark(int frames, int objectCount, const char *outputPrefix);
+float randomFloat(Uint32 *state);
+int syntheticTerrain(int side, float **positions, unsigned int **indices, int *indexCount);
+void timeBVH(const char *name, const float *positions, int vertexCount, int stride, const unsigned int *indices,
+             int indexCount, int rays);
+int runBVHBenchmark(int rays);
+void scalarMultiplyMatrices(Mat4x4 *result, const Mat4x4 *a, const Mat4x4 *b);
+void scalarMultiplyMatrixVec4(Vec4 *result, const Mat4x4 *mat, const Vec4 *vec);
+void scalarTransformPositions(float *outX, float *outY, float *outZ, const Mat4x4 *mat,
+                              const float *x, const float *y, const float *z, int count);
+float nanosecondsSince(Uint64 start, long long ops);
+int runMathBenchmark(int iterations);
 
 Camera setupCamera() {
-    Mat4x4 model = {0}, view = {0}, projection = {0};
+    Mat4x4 model = {0}, view = {0};
+    Mat4x4 projection = perspectiveMatrix(FOV, aspectRatio, Z_NEAR, Z_FAR);
     Vertex eye = {0.0f, 0.0f, 4.0f};
     Vertex target = {0.0f, 0.0f, 0.0f};
     Vertex up = {0.0f, 1.0f, 0.0f};
-    float angleX = 0.0f, angleY = 0.0f, angleZ = 0.0f;
 
     Camera cam = {
         .model = model, .view = view, .projection = projection,
         .eye = eye, .target = target, .up = up, 
-        .angleX = angleX, .angleY = angleY, .angleZ = angleZ
+        .orientation = quatIdentity(), .modelDirty = 1
     };
     return cam;
 }
 
+// Backs the camera off along +z until the whole bounding sphere fits in the view
+void fitCameraToBounds(Camera *cam, Bounds bounds) {
+    if (bounds.radius <= 0.0f)
+        return;
+
+    float distance = bounds.radius / sinf(FOV / 2.0f);
+    cam->target = (Vertex){bounds.center[0], bounds.center[1], bounds.center[2]};
+    cam->eye = (Vertex){bounds.center[0], bounds.center[1], bounds.center[2] + distance};
+}
+
+// One orbit of the scene over t from 0 to 1, bobbing up and down and dollying
+// in to half the fitting distance halfway round
+void flyBenchmarkPath(Camera *cam, Bounds bounds, float t)
+{
+    fitCameraToBounds(cam, bounds);
+    float dolly = 0.75f + 0.25f * cosf(2.0f * M_PI * t);
+    cam->eye.z = cam->target.z + (cam->eye.z - cam->target.z) * dolly;
+
+    Quat yaw = quatFromAxisAngle(0.0f, 1.0f, 0.0f, 2.0f * M_PI * t);
+    Quat pitch = quatFromAxisAngle(1.0f, 0.0f, 0.0f, 0.4f * sinf(2.0f * M_PI * t));
+    cam->orientation = quatNormalize(quatMultiply(yaw, pitch));
+    cam->modelDirty = 1;
+}
+
 int main(int argc, char *argv[])
 {   
+    // --headless N renders N frames of a turntable offscreen and writes them to <output>NNNN.png
+    // --batch LIST renders --angles K (8 by default) views of every OBJ in LIST, also offscreen
+    int headlessFrames = 0;
+    const char *outputPrefix = "frame";
+    const char *batchList = NULL;
+    int batchAngles = 8;
+    // --soft N times N frames on the software rasterizer, --objects N adds N monkeys sharing
+    // the first monkey's geometry
+    int softFrames = 0;
+    int objectCount = 0;
+    // --bvh N times BVH builds and N rays against Helicopter.obj and synthetic terrains of
+    // 1, 2 and 4 million triangles
+    int bvhRays = 0;
+    // --mathbench N times N rounds of each SIMD matrix kernel against its scalar form, in ns per op
+    int mathIterations = 0;
+    // --trace FILE records zones on every thread and the GPU and writes them to FILE on exit,
+    // t writes it at any point
+    const char *traceFile = NULL;
+    // --benchmark N flies a fixed camera path over the scene for N frames with vsync off and
+    // writes frame, CPU and GPU times to --report FILE (benchmark.json). --offscreen renders
+    // into the headless framebuffer instead of a window.
+    int benchmarkFrames = 0;
+    const char *reportFile = "benchmark.json";
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+            headlessFrames = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--output") == 0)
+            outputPrefix = argv[i + 1];
+        else if (strcmp(argv[i], "--batch") == 0)
+            batchList = argv[i + 1];
+        else if (strcmp(argv[i], "--angles") == 0)
+            batchAngles = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--soft") == 0)
+            softFrames = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--objects") == 0)
+            objectCount = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--bvh") == 0)
+            bvhRays = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--mathbench") == 0)
+            mathIterations = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--trace") == 0)
+            traceFile = argv[i + 1];
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            benchmarkFrames = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--report") == 0)
+            reportFile = argv[i + 1];
+    }
+    // --profile starts with the frame profiler on, p toggles it in the window
+    int profile = 0;
+    int offscreenBenchmark = 0;
+    // The window only redraws when something changed, --continuous draws every vsync regardless
+    int continuous = 0;
+    // --multidraw starts on the multi-draw indirect path, m switches paths in the window
+    int startMultiDraw = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--profile") == 0)
+            profile = 1;
+        else if (strcmp(argv[i], "--offscreen") == 0)
+            offscreenBenchmark = 1;
+        else if (strcmp(argv[i], "--continuous") == 0)
+            continuous = 1;
+        else if (strcmp(argv[i], "--multidraw") == 0)
+            startMultiDraw = 1;
+    }
+    // The benchmark replaces the turntable, both would drive the camera
+    if (benchmarkFrames > 0)
+        headlessFrames = 0;
+    if (traceFile)
+    {
+        startTrace();
+        nameTraceThread("main");
+    }
+    if (softFrames > 0)
+    {
+        int done = runSoftBenchmark(softFrames, objectCount, outputPrefix);
+        if (traceFile)
+            writeTrace(traceFile);
+        stopTrace();
+        return done ? 0 : -1;
+    }
+    if (mathIterations > 0)
+        return runMathBenchmark(mathIterations) ? 0 : -1;
+    if (bvhRays > 0)
+    {
+        int done = runBVHBenchmark(bvhRays);
+        if (traceFile)
+            writeTrace(traceFile);
+        stopTrace();
+        return done ? 0 : -1;
+    }
+    int offscreen = headlessFrames > 0 || batchList || (benchmarkFrames > 0 && offscreenBenchmark);
+
     WindowModel wm;
-    if (!initializeWindow(&wm))
+    Headless headless;
+    if (offscreen ? !initializeHeadless(&wm, &headless) : !initializeWindow(&wm))
         return -1;
-    EventH eh = {.running = 1, .fullScreen = 0, .r = 0, .n = 0};
+    syncGPUTrace();
+    if (benchmarkFrames > 0 && !offscreen && SDL_GL_SetSwapInterval(0) != 0)
+        printf("Could not turn vsync off, frame times are capped by the display: %s\n", SDL_GetError());
+    EventH eh = {.running = 1, .fullScreen = 0, .r = offscreen || benchmarkFrames > 0, .n = 0, .profile = profile, .dirty = 1,
+                 .multiDraw = startMultiDraw};
     Camera cam = setupCamera();
     wm.eh = &eh;
     wm.cam = &cam;
+    wm.profiler = NULL;
 
-    setupMatrices(&cam.model, &cam.view, &cam.projection, wm.shaderProgram, cam.eye, cam.target, cam.up);
+    if (batchList)
+    {
+        int done = runBatch(&wm, &headless, batchList, batchAngles > 0 ? batchAngles : 1, outputPrefix);
+        if (traceFile)
+        {
+            collectGPUTrace();
+            writeTrace(traceFile);
+        }
+        stopTrace();
+        destroyHeadless(&headless);
+        SDL_Quit();
+        return done ? 0 : -1;
+    }
 
-    Mesh meshes[10];
+    GeometryArena *arena = createGeometryArena(ARENA_VERTICES, ARENA_INDICES);
+    Mesh *meshes = malloc((3 + objectCount) * sizeof(Mesh));
+    int ownedMeshCount = 3;
     int meshCount = 3;
-    meshes[0] = parseOBJ(OBJ_IXO_SPHERE, POS(0.0f, 0.0f, 0.0f), "red", 0.5f);
-    meshes[1] = parseOBJ(OBJ_MONKEY, POS(2.0f, 0.0f, 0.0f), "yellow", 1.0f);
-    meshes[2] = parseOBJ("models/Helicopter.obj", POS(-2.0f, 0.0f, 0.0f), "cyan", 1.0f);
+    meshes[0] = parseOBJ(arena, OBJ_IXO_SPHERE, POS(0.0f, 0.0f, 0.0f), "red", 0.5f);
+    meshes[1] = parseOBJ(arena, OBJ_MONKEY, POS(2.0f, 0.0f, 0.0f), "yellow", 1.0f);
+    meshes[2] = parseOBJ(arena, "models/Helicopter.obj", POS(-2.0f, 0.0f, 0.0f), "cyan", 1.0f);
+    for (int i = 0; i < objectCount; i++)
+    {
+        // The colour stays the one baked into the shared vertices
+        float color[3];
+        Mesh *copy = &meshes[meshCount++];
+        *copy = meshes[1];
+        setMeshTransform(copy, stressTransform(i, objectCount, color));
+        updateMeshTransform(copy);
+    }
 
-    loadShaders(&wm.shaderProgram);
+    Bounds sceneBounds = {0};
+    for (int i = 0; i < ownedMeshCount; i++)
+    {
+        if (meshes[i].bvh)
+            printf("Mesh %d: %d triangles, BVH with %d nodes built in %.2f ms\n",
+                   i, meshes[i].indiceCount / 3, meshes[i].bvh->nodeCount, meshes[i].bvh->buildTime);
+    }
+    for (int i = 0; i < meshCount; i++)
+    {
+        sceneBounds = mergeBounds(sceneBounds, meshes[i].bounds);
+    }
+
+    // --instances N adds N monkeys sharing one mesh, drawn with a single instanced call
+    int instanceCount = 0;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--instances") == 0)
+            instanceCount = atoi(argv[i + 1]);
+    }
+    Mesh instanceMesh = {0};
+    InstanceBatch batch = {0};
+    if (instanceCount > 0)
+    {
+        instanceMesh = parseOBJ(arena, OBJ_MONKEY, POS(0.0f, 0.0f, 0.0f), "yellow", 1.0f);
+        batch = createInstanceBatch(&instanceMesh, instanceCount);
+        for (int i = 0; i < instanceCount; i++)
+        {
+            float color[3];
+            Transform transform = stressTransform(i, instanceCount, color);
+            addInstance(&batch, transform, color);
+        }
+        sceneBounds = mergeBounds(sceneBounds, batch.bounds);
+
+        double meshBytes = instanceMesh.vertexCount * sizeof(Vertex) + instanceMesh.indiceCount * sizeof(unsigned int);
+        printf("%d instances: %.1f MB in %d draw calls as separate meshes, %.1f MB in 1 draw call instanced\n",
+               batch.count, batch.count * meshBytes / (1024.0 * 1024.0), batch.count,
+               (meshBytes + batch.count * sizeof(InstanceData)) / (1024.0 * 1024.0));
+    }
+    fitCameraToBounds(&cam, sceneBounds);
+
+    CullSet cullSet = createCullSet(meshCount);
+    for (int i = 0; i < meshCount; i++)
+    {
+        addCullBounds(&cullSet, meshes[i].bounds);
+    }
+    Frustum frustum;
+    OcclusionBuffer *occlusion = createOcclusionBuffer(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, SDL_GetCPUCount() - 1);
+    int lastVisibleCount = -1, lastOccludedCount = -1;
+
+    loadShaders(&wm.shader);
+    loadInstancedShaders(&wm.instancedShader);
+    UniformBuffers ub = createUniformBuffers(&wm.shader, meshCount + 1);
+    FrameUniforms frame = {
+        .lightPos = {6.0f, 2.0f, 6.0f, 1.0f},
+        .lightColor = {1.0f, 1.0f, 1.0f, 1.0f},
+        .objectColor = {0.5f, 0.5f, 0.5f, 1.0f}
+    };
+    int lastGLCalls = -1;
+
+    IndirectDraws indirect = createIndirectDraws(arena, meshCount);
+    RenderQueue queue = createRenderQueue(meshCount + 1);
+    if (!indirectDrawsSupported())
+        printf("Multi-draw indirect is not available, meshes are drawn one by one\n");
+    float submitTime = 0.0f;
+    int submitFrames = 0;
+    int frameNumber = 0;
+    float headlessRenderTime = 0.0f, headlessCaptureTime = 0.0f;
+    Capture *capture = NULL;
+    if (headlessFrames > 0)
+        capture = createCapture(headless.width, headless.height, outputPrefix);
+    Benchmark *bench = benchmarkFrames > 0 ? createBenchmark(benchmarkFrames) : NULL;
     
     while (wm.eh->running)
     {
-        getWindowEvents(&wm, &cam.eye, &cam.target, &cam.angleX, &cam.angleY);
+        resetGLStats();
+        if (bench)
+        {
+            beginBenchmarkFrame(bench);
+            // Events are still polled so the window can be closed, the path overrides the camera
+            if (!offscreen)
+                getWindowEvents(&wm, &cam.eye, &cam.target, &cam.orientation, 0);
+            flyBenchmarkPath(&cam, sceneBounds, benchmarkProgress(bench));
+        }
+        else if (headlessFrames > 0)
+        {
+            // One full turn of the scene over all the frames
+            Quat step = quatFromAxisAngle(0.0f, 1.0f, 0.0f, 2.0f * M_PI / headlessFrames);
+            if (frameNumber > 0)
+                cam.orientation = quatNormalize(quatMultiply(step, cam.orientation));
+            cam.modelDirty = 1;
+        }
+        else
+        {
+            // With nothing to draw, sleep until an event comes in instead of redrawing the same frame
+            int idle = !continuous && !capture && !eh.dirty;
+            getWindowEvents(&wm, &cam.eye, &cam.target, &cam.orientation, idle ? IDLE_WAIT_MS : 0);
+
+            // c starts and stops capturing the window to captureNNNN.png
+            if (eh.capture && !capture)
+            {
+                int width, height;
+                SDL_GL_GetDrawableSize(wm.win, &width, &height);
+                capture = createCapture(width, height, "capture");
+            }
+            else if (!eh.capture && capture)
+            {
+                stopCapture(capture);
+                capture = NULL;
+            }
+
+            // Meshes moved by anything other than input count as a change too
+            for (int i = 0; i < meshCount && !eh.dirty; i++)
+            {
+                if (meshes[i].transformDirty)
+                    eh.dirty = 1;
+            }
+            if (!continuous && !capture && !eh.dirty)
+                continue;
+        }
+
+        if (eh.profile && !wm.profiler)
+        {
+            wm.profiler = createProfiler();
+        }
+        else if (!eh.profile && wm.profiler)
+        {
+            printProfile(wm.profiler);
+            destroyProfiler(wm.profiler);
+            wm.profiler = NULL;
+        }
+        beginProfileFrame(wm.profiler);
+        collectGPUTrace();
+        if (eh.writeTrace)
+        {
+            if (traceFile)
+                writeTrace(traceFile);
+            else
+                printf("Start with --trace FILE to record a trace\n");
+            eh.writeTrace = 0;
+        }
 
-        glUniform3f(glGetUniformLocation(wm.shaderProgram, "lightPos"), 6.0f, 2.0f, 6.0f);
-        glUniform3f(glGetUniformLocation(wm.shaderProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
-        glUniform3f(glGetUniformLocation(wm.shaderProgram, "objectColor"), 0.5f, 0.5f, 0.5f);
-        glUniform3f(glGetUniformLocation(wm.shaderProgram, "viewPos"), cam.eye.x, cam.eye.y, cam.eye.z);
+        int cullScope = beginProfile(wm.profiler, "cull");
+        TraceZone cullZone = beginZone("cull");
+        lookAt(&cam.view, cam.eye, cam.target, cam.up);
+        if (cam.modelDirty)
+        {
+            quatToMatrix(&cam.model, cam.orientation);
+            cam.modelDirty = 0;
+        }
 
-        setupMatrices(&cam.model, &cam.view, &cam.projection, wm.shaderProgram, cam.eye, cam.target, cam.up);
-        createRotationMatrix(&cam.model, cam.angleX, cam.angleY, cam.angleZ);
+        for (int i = 0; i < meshCount; i++)
+        {
+            if (updateMeshTransform(&meshes[i]))
+                setCullBounds(&cullSet, i, meshes[i].bounds);
+        }
 
-        unsigned int modelLoc = glGetUniformLocation(wm.shaderProgram, "model");
-        unsigned int viewLoc = glGetUniformLocation(wm.shaderProgram, "view");
-        unsigned int projLoc = glGetUniformLocation(wm.shaderProgram, "projection");
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &cam.model.m[0][0]);
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &cam.view.m[0][0]);
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, &cam.projection.m[0][0]);
+        Mat4x4 clip;
+        clipMatrix(&clip, &cam.model, &cam.view, &cam.projection);
+        extractFrustum(&frustum, &clip);
+        int visibleCount = cullFrustum(&cullSet, &frustum);
 
-        render(wm.shaderProgram, wm.eh, meshes, meshCount);
-        SDL_GL_SwapWindow(wm.win);
+        clearOcclusionBuffer(occlusion, &clip);
+        int occludedCount = cullOccluded(occlusion, meshes, cullSet.visible, meshCount);
+        visibleCount -= occludedCount;
+        cullSet.visibleCount = visibleCount;
+        endZone(cullZone);
+        endProfile(wm.profiler, cullScope);
+
+        if (visibleCount != lastVisibleCount || occludedCount != lastOccludedCount)
+        {
+            printf("Culling: %d visible, %d outside frustum, %d occluded\n",
+                   visibleCount, cullSet.count - visibleCount - occludedCount, occludedCount);
+            lastVisibleCount = visibleCount;
+            lastOccludedCount = occludedCount;
+        }
+
+        if (eh.pick)
+        {
+            pickUnderCursor(&wm, meshes, meshCount);
+            eh.pick = 0;
+        }
+
+        frame.view = cam.view;
+        frame.projection = cam.projection;
+        frame.viewPos[0] = cam.eye.x;
+        frame.viewPos[1] = cam.eye.y;
+        frame.viewPos[2] = cam.eye.z;
+        frame.viewPos[3] = 1.0f;
+        setFrameUniforms(&ub, &frame);
+
+        if (batch.count > 0)
+            cullInstances(&batch, &frustum);
+
+        int multiDraw = eh.multiDraw && indirectDrawsSupported();
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        submitTime += render(&wm, &ub, &queue, arena, meshes, meshCount, cullSet.visible,
+                             batch.count > 0 ? &batch : NULL, multiDraw ? &indirect : NULL);
+        if (bench)
+            submitBenchmarkFrame(bench);
+        if (headlessFrames > 0)
+        {
+            // Wait for the frame so the time covers the rasterizing, not just the submit
+            int finishScope = beginProfile(wm.profiler, "finish");
+            TraceZone finishZone = beginZone("finish");
+            glFinish();
+            endZone(finishZone);
+            endProfile(wm.profiler, finishScope);
+            Uint64 captureStart = SDL_GetPerformanceCounter();
+            int captureScope = beginProfile(wm.profiler, "capture");
+            captureFrame(capture, frameNumber);
+            endProfile(wm.profiler, captureScope);
+            Uint64 captureEnd = SDL_GetPerformanceCounter();
+            headlessRenderTime += (captureStart - frameStart) * 1000.0f / SDL_GetPerformanceFrequency();
+            headlessCaptureTime += (captureEnd - captureStart) * 1000.0f / SDL_GetPerformanceFrequency();
+
+            if (frameNumber + 1 == headlessFrames)
+            {
+                printf("Headless: %d frames at %dx%d, %.3f ms render and %.3f ms capture per frame\n",
+                       headlessFrames, headless.width, headless.height,
+                       headlessRenderTime / headlessFrames, headlessCaptureTime / headlessFrames);
+                eh.running = 0;
+            }
+        }
+        else if (offscreen)
+        {
+            // Nothing paces the frames without a swap, so each one waits for the GPU
+            glFinish();
+        }
+        else
+        {
+            // Read before the swap, the back buffer is undefined after it
+            if (capture)
+            {
+                int captureScope = beginProfile(wm.profiler, "capture");
+                captureFrame(capture, frameNumber);
+                endProfile(wm.profiler, captureScope);
+            }
+            int swapScope = beginProfile(wm.profiler, "swap");
+            TraceZone swapZone = beginGPUZone("swap");
+            SDL_GL_SwapWindow(wm.win);
+            endGPUZone(swapZone);
+            endProfile(wm.profiler, swapScope);
+            eh.dirty = 0;
+        }
+        endProfileFrame(wm.profiler);
+        frameNumber++;
+        if (bench)
+        {
+            endBenchmarkFrame(bench);
+            if (benchmarkDone(bench))
+                eh.running = 0;
+        }
+
+        // Also reported when the run ends, headless runs may be shorter than 120 frames
+        if (++submitFrames == 120 || !eh.running)
+        {
+            printf("Submit (%s): %.3f ms per frame for %d visible meshes\n",
+                   multiDraw ? "multi-draw indirect" : "per mesh", submitTime / submitFrames, cullSet.visibleCount);
+            submitTime = 0.0f;
+            submitFrames = 0;
+            if (wm.profiler)
+                printProfile(wm.profiler);
+        }
+
+        if (totalGLCalls(&glStats) != lastGLCalls)
+        {
+            printGLStats(&glStats);
+            lastGLCalls = totalGLCalls(&glStats);
+        }
     }
 
-    for (int i = 0; i < meshCount; i++)
+    if (capture)
+        stopCapture(capture);
+    if (bench)
+    {
+        BenchmarkScene scene = {.meshes = meshCount, .instances = batch.count};
+        if (offscreen)
+        {
+            scene.width = headless.width;
+            scene.height = headless.height;
+        }
+        else
+        {
+            SDL_GL_GetDrawableSize(wm.win, &scene.width, &scene.height);
+        }
+        for (int i = 0; i < meshCount; i++)
+        {
+            scene.triangles += meshes[i].indiceCount / 3;
+        }
+        scene.triangles += (long long)batch.count * (instanceMesh.indiceCount / 3);
+        writeBenchmarkReport(bench, &scene, reportFile);
+        destroyBenchmark(bench);
+    }
+    if (wm.profiler)
+    {
+        printProfile(wm.profiler);
+        destroyProfiler(wm.profiler);
+    }
+    if (traceFile)
+    {
+        collectGPUTrace();
+        writeTrace(traceFile);
+    }
+    stopTrace();
+
+    // Copies share the geometry of the meshes they were made from
+    for (int i = 0; i < ownedMeshCount; i++)
     {
         destroyMesh(&meshes[i]);
     }
+    free(meshes);
+    destroyIndirectDraws(&indirect);
+    destroyRenderQueue(&queue);
+    destroyCullSet(&cullSet);
+    destroyOcclusionBuffer(occlusion);
+    destroyUniformBuffers(&ub);
+    if (instanceCount > 0)
+    {
+        destroyInstanceBatch(&batch);
+        destroyMesh(&instanceMesh);
+    }
+    destroyGeometryArena(arena);
 
-    glDeleteProgram(wm.shaderProgram);
+    glDeleteProgram(wm.shader.id);
+    glDeleteProgram(wm.instancedShader.id);
 
-    SDL_GL_DeleteContext(wm.glContext);
-    SDL_DestroyWindow(wm.win);
+    if (offscreen)
+    {
+        destroyHeadless(&headless);
+    }
+    else
+    {
+        SDL_GL_DeleteContext(wm.glContext);
+        SDL_DestroyWindow(wm.win);
+    }
     SDL_Quit();
 
     return 0;
 }
 
-void render(unsigned int shaderProgram, EventH *eh, Mesh *mesh, int meshCount)
+// Distance in front of the camera of a point in scene space
+float viewDepth(const Camera *cam, const float *p)
+{
+    float world[3];
+    for (int r = 0; r < 3; r++)
+    {
+        world[r] = cam->model.m[0][r] * p[0] + cam->model.m[1][r] * p[1] + cam->model.m[2][r] * p[2] + cam->model.m[3][r];
+    }
+    return -(cam->view.m[0][2] * world[0] + cam->view.m[1][2] * world[1] + cam->view.m[2][2] * world[2] + cam->view.m[3][2]);
+}
+
+// Issues the queued draws in key order, touching program and VAO only when they change
+void drawRenderQueue(const RenderQueue *queue, UniformBuffers *ub, int mode, Profiler *prof, const Mesh *meshes)
+{
+    unsigned int program = 0, VAO = 0;
+    for (int i = 0; i < queue->count; i++)
+    {
+        const RenderItem *item = &queue->items[queue->order[i]];
+        if (item->program != program)
+        {
+            glUseProgram(item->program);
+            glStats.programBinds++;
+            program = item->program;
+        }
+        if (item->VAO != VAO)
+        {
+            glBindVertexArray(item->VAO);
+            glStats.vertexArrayBinds++;
+            VAO = item->VAO;
+        }
+        if (item->object >= 0)
+            bindObjectUniforms(ub, item->object);
+
+        int scope = -1;
+        if (prof)
+        {
+            char name[PROFILE_NAME] = "multi-draw";
+            if (item->type == RENDER_INSTANCES)
+                snprintf(name, sizeof(name), "instances");
+            else if (item->type == RENDER_MESH && (const Mesh*)item->draw - meshes < PROFILE_MESHES)
+                snprintf(name, sizeof(name), "mesh %d", (int)((const Mesh*)item->draw - meshes));
+            else if (item->type == RENDER_MESH)
+                snprintf(name, sizeof(name), "other meshes");
+            scope = beginProfile(prof, name);
+        }
+
+        switch (item->type)
+        {
+        case RENDER_MESH:
+            renderMesh(*(const Mesh*)item->draw, mode);
+            break;
+        case RENDER_INSTANCES:
+            drawInstances(item->draw, mode);
+            break;
+        case RENDER_INDIRECT:
+            submitIndirectDraws(item->draw, mode);
+            break;
+        }
+        endProfile(prof, scope);
+    }
+    if (VAO != 0)
+    {
+        glBindVertexArray(0);
+        glStats.vertexArrayBinds++;
+    }
+}
+
+// Returns the CPU time spent queueing, sorting and submitting the draws, in milliseconds
+float render(WindowModel *wm, UniformBuffers *ub, RenderQueue *queue, GeometryArena *arena, Mesh *mesh, int meshCount,
+             const unsigned char *visible, InstanceBatch *batch, IndirectDraws *indirect)
 {
+    const Camera *cam = wm->cam;
+    int mode = wm->eh->r ? GL_TRIANGLES : GL_LINE_LOOP;
+    TraceZone zone = beginGPUZone("render");
+    int clearScope = beginProfile(wm->profiler, "clear");
     glClearColor(0.6f, 0.6f, 0.6f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(shaderProgram);
+    endProfile(wm->profiler, clearScope);
+
+    Uint64 submitStart = SDL_GetPerformanceCounter();
+    int queueScope = beginProfile(wm->profiler, "queue");
+    clearRenderQueue(queue);
+
+    // Every visible mesh gets its object block first so they all go up in one write.
+    // Indirect draws carry their transforms as instance data instead.
+    int sceneObject = -1;
+    if (batch || indirect)
+    {
+        Mat3x3 normal;
+        normalMatrix(&normal, &cam->model);
+        sceneObject = addObjectUniforms(ub, &cam->model, &normal);
+    }
+    if (indirect)
+    {
+        buildIndirectDraws(indirect, mesh, visible, meshCount);
+        RenderItem item = {RENDER_INDIRECT, indirect, wm->instancedShader.id, indirect->VAO, sceneObject};
+        pushRenderItem(queue, renderKey(PASS_OPAQUE, item.program, 0, item.VAO, 0.0f), item);
+    }
+    else
+    {
+        for (int i = 0; i < meshCount; i++)
+        {
+            if (!visible[i])
+                continue;
+            // The orbit rotation turns the whole scene, on top of each mesh's own transform
+            Mat4x4 model;
+            Mat3x3 normal;
+            multiplyMatricesPtr(&model, &mesh[i].model, &cam->model);
+            normalMatrix(&normal, &model);
+            // One VAO for every mesh, they only differ in their offsets into it.
+            // Colours live in the vertices, so there is no material to tell meshes apart yet.
+            RenderItem item = {RENDER_MESH, &mesh[i], wm->shader.id, arena->VAO, addObjectUniforms(ub, &model, &normal)};
+            float depth = viewDepth(cam, mesh[i].bounds.center) - mesh[i].bounds.radius;
+            pushRenderItem(queue, renderKey(PASS_OPAQUE, item.program, 0, item.VAO, depth), item);
+        }
+    }
+    if (batch && batch->drawnCount > 0)
+    {
+        RenderItem item = {RENDER_INSTANCES, batch, wm->instancedShader.id, batch->VAO, sceneObject};
+        float depth = viewDepth(cam, batch->bounds.center) - batch->bounds.radius;
+        pushRenderItem(queue, renderKey(PASS_OPAQUE, item.program, 0, item.VAO, depth), item);
+    }
+    uploadObjectUniforms(ub);
+
+    sortRenderQueue(queue);
+    endProfile(wm->profiler, queueScope);
+    drawRenderQueue(queue, ub, mode, wm->profiler, mesh);
+    float submitTime = (SDL_GetPerformanceCounter() - submitStart) * 1000.0f / SDL_GetPerformanceFrequency();
+    endGPUZone(zone);
+    return submitTime;
+}
+
+// Waits for the frames still being read back and written, then reports
+void stopCapture(Capture *capture)
+{
+    flushCapture(capture);
+    printf("Captured %d frames, %d waited on the GPU, %d on the PNG writer\n",
+           capture->captured, capture->fenceStalls, capture->writerStalls);
+    destroyCapture(capture);
+}
+
+// Renders a turntable of every OBJ listed in listFile to <output><name>_NN.png,
+// one model per line. The next models are parsed on worker threads while one renders.
+int runBatch(WindowModel *wm, const Headless *hl, const char *listFile, int angles, const char *outputPrefix)
+{
+    FILE *fp = fopen(listFile, "r");
+    if (!fp)
+    {
+        printf("Could not open file %s\n", listFile);
+        return 0;
+    }
+    char **paths = NULL;
+    int pathCount = 0, pathCapacity = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (pathCount == pathCapacity)
+        {
+            pathCapacity = pathCapacity ? pathCapacity * 2 : 16;
+            paths = realloc(paths, pathCapacity * sizeof(char *));
+        }
+        paths[pathCount++] = strdup(line);
+    }
+    fclose(fp);
+
+    GeometryArena *arena = createGeometryArena(ARENA_VERTICES, ARENA_INDICES);
+    loadShaders(&wm->shader);
+    UniformBuffers ub = createUniformBuffers(&wm->shader, 1);
+    RenderQueue queue = createRenderQueue(1);
+    FrameUniforms frame = {
+        .lightPos = {6.0f, 2.0f, 6.0f, 1.0f},
+        .lightColor = {1.0f, 1.0f, 1.0f, 1.0f},
+        .objectColor = {0.5f, 0.5f, 0.5f, 1.0f}
+    };
+    Capture *capture = createCapture(hl->width, hl->height, outputPrefix);
+    ModelLoader *loader = createModelLoader(paths, pathCount, SDL_GetCPUCount() - 1);
+    const unsigned char visible = 1;
+    int rendered = 0;
+    float waitTime = 0.0f;
+
+    Uint64 batchStart = SDL_GetPerformanceCounter();
+    for (int i = 0; i < pathCount; i++)
+    {
+        Uint64 waitStart = SDL_GetPerformanceCounter();
+        LoadedModel *model = waitForModel(loader, i);
+        waitTime += (SDL_GetPerformanceCounter() - waitStart) * 1000.0f / SDL_GetPerformanceFrequency();
+
+        Mesh *mesh = &model->mesh;
+        if (mesh->vertexCount == 0 || !uploadMesh(arena, mesh))
+        {
+            printf("Skipping %s\n", paths[i]);
+            destroyMesh(mesh);
+            releaseModel(loader, i);
+            continue;
+        }
+
+        // The turntable turns about the origin, so the model is moved onto it
+        float center[3] = {-mesh->localBounds.center[0], -mesh->localBounds.center[1], -mesh->localBounds.center[2]};
+        setMeshTransform(mesh, createTransform(center, 1.0f));
+        updateMeshTransform(mesh);
+        Camera *cam = wm->cam;
+        *cam = setupCamera();
+        fitCameraToBounds(cam, mesh->bounds);
+        lookAt(&cam->view, cam->eye, cam->target, cam->up);
+
+        // File name without directory and extension
+        const char *name = paths[i];
+        for (const char *c = paths[i]; *c; c++)
+        {
+            if (*c == '/' || *c == '\\')
+                name = c + 1;
+        }
+        const char *dot = strrchr(name, '.');
+        int nameLength = dot ? (int)(dot - name) : (int)strlen(name);
+
+        for (int k = 0; k < angles; k++)
+        {
+            cam->orientation = quatFromAxisAngle(0.0f, 1.0f, 0.0f, 2.0f * M_PI * k / angles);
+            quatToMatrix(&cam->model, cam->orientation);
+
+            frame.view = cam->view;
+            frame.projection = cam->projection;
+            frame.viewPos[0] = cam->eye.x;
+            frame.viewPos[1] = cam->eye.y;
+            frame.viewPos[2] = cam->eye.z;
+            frame.viewPos[3] = 1.0f;
+            setFrameUniforms(&ub, &frame);
+            render(wm, &ub, &queue, arena, mesh, 1, &visible, NULL, NULL);
+            collectGPUTrace();
+
+            char path[CAPTURE_PATH];
+            snprintf(path, sizeof(path), "%s%.*s_%02d.png", outputPrefix, nameLength, name, k);
+            captureFrameAs(capture, path);
+        }
+        rendered++;
+        destroyMesh(mesh);
+        releaseModel(loader, i);
+    }
+    stopCapture(capture);
+    float batchTime = (SDL_GetPerformanceCounter() - batchStart) * 1000.0f / SDL_GetPerformanceFrequency();
+    printf("Batch: %d models, %d images in %.2f s, %.1f models/minute, %.0f ms waiting for loads\n",
+           rendered, rendered * angles, batchTime / 1000.0f, rendered * 60000.0f / batchTime, waitTime);
+
+    destroyModelLoader(loader);
+    destroyRenderQueue(&queue);
+    destroyUniformBuffers(&ub);
+    destroyGeometryArena(arena);
+    glDeleteProgram(wm->shader.id);
+    for (int i = 0; i < pathCount; i++)
+    {
+        free(paths[i]);
+    }
+    free(paths);
+    return 1;
+}
+
+// Renders a turntable of the default scene on the CPU rasterizer with 1, 2, 4 ... threads.
+// Needs no GL at all, the last frame is written to <output>soft.png.
+int runSoftBenchmark(int frames, int objectCount, const char *outputPrefix)
+{
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        printf("error initializing SDL: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    Mesh *meshes = malloc((3 + objectCount) * sizeof(Mesh));
+    int meshCount = 3;
+    meshes[0] = loadOBJ(OBJ_IXO_SPHERE, POS(0.0f, 0.0f, 0.0f), "red", 0.5f);
+    meshes[1] = loadOBJ(OBJ_MONKEY, POS(2.0f, 0.0f, 0.0f), "yellow", 1.0f);
+    meshes[2] = loadOBJ("models/Helicopter.obj", POS(-2.0f, 0.0f, 0.0f), "cyan", 1.0f);
+    for (int i = 0; i < objectCount; i++)
+    {
+        float color[3];
+        Mesh *copy = &meshes[meshCount++];
+        *copy = meshes[1];
+        setMeshTransform(copy, stressTransform(i, objectCount, color));
+        updateMeshTransform(copy);
+    }
+    Bounds sceneBounds = {0};
+    long long triangles = 0;
     for (int i = 0; i < meshCount; i++)
     {
-        if (eh->r)
+        sceneBounds = mergeBounds(sceneBounds, meshes[i].bounds);
+        triangles += meshes[i].indiceCount / 3;
+    }
+
+    Camera cam = setupCamera();
+    fitCameraToBounds(&cam, sceneBounds);
+    lookAt(&cam.view, cam.eye, cam.target, cam.up);
+    FrameUniforms frame = {
+        .view = cam.view,
+        .projection = cam.projection,
+        .viewPos = {cam.eye.x, cam.eye.y, cam.eye.z, 1.0f},
+        .lightPos = {6.0f, 2.0f, 6.0f, 1.0f},
+        .lightColor = {1.0f, 1.0f, 1.0f, 1.0f},
+        .objectColor = {0.5f, 0.5f, 0.5f, 1.0f}
+    };
+    float clearColor[3] = {0.6f, 0.6f, 0.6f};
+    int width = SW, height = SH;
+    printf("Software rasterizer: %lld triangles, %d frames at %dx%d\n", triangles, frames, width, height);
+
+    int cpus = SDL_GetCPUCount();
+    for (int threads = 1; ; threads = threads * 2 < cpus ? threads * 2 : cpus)
+    {
+        SoftRasterizer *sr = createSoftRasterizer(width, height, threads - 1);
+        long long fragments = 0;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int f = 0; f < frames; f++)
         {
-            renderMesh(mesh[i], GL_TRIANGLES);
+            quatToMatrix(&cam.model, quatFromAxisAngle(0.0f, 1.0f, 0.0f, 2.0f * M_PI * f / frames));
+            renderSoft(sr, meshes, meshCount, NULL, &cam.model, &frame, clearColor);
+            fragments += sr->fragmentCount;
         }
-        else
+        float seconds = (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+        printf("%2d threads: %.2f ms per frame, %.2f Mtri/s, %.1f Mpix/s\n", threads, seconds * 1000.0f / frames,
+               triangles * frames / seconds / 1e6f, fragments / seconds / 1e6f);
+
+        if (threads == cpus)
+        {
+            char path[512];
+            snprintf(path, sizeof(path), "%ssoft.png", outputPrefix);
+            SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(sr->color, width, height, 32, sr->stride * sizeof(unsigned int),
+                                                                      SDL_PIXELFORMAT_RGBA32);
+            if (!surface || IMG_SavePNG(surface, path) != 0)
+                printf("Failed to write %s: %s\n", path, IMG_GetError());
+            SDL_FreeSurface(surface);
+            destroySoftRasterizer(sr);
+            break;
+        }
+        destroySoftRasterizer(sr);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        destroyMesh(&meshes[i]);
+    }
+    free(meshes);
+    SDL_Quit();
+    return 1;
+}
+
+float randomFloat(Uint32 *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// side * side vertices over [-1, 1] with rolling hills, two triangles per cell.
+// Returns the vertex count, positions are three floats each.
+int syntheticTerrain(int side, float **positions, unsigned int **indices, int *indexCount)
+{
+    *positions = malloc((size_t)side * side * 3 * sizeof(float));
+    *indices = malloc((size_t)(side - 1) * (side - 1) * 6 * sizeof(unsigned int));
+    for (int z = 0; z < side; z++)
+    {
+        for (int x = 0; x < side; x++)
         {
-            renderMesh(mesh[i], GL_LINE_LOOP);
+            float *p = *positions + ((size_t)z * side + x) * 3;
+            p[0] = -1.0f + 2.0f * x / (side - 1);
+            p[2] = -1.0f + 2.0f * z / (side - 1);
+            p[1] = 0.1f * sinf(p[0] * 12.0f) * cosf(p[2] * 9.0f) + 0.03f * sinf((p[0] + p[2]) * 37.0f);
         }
     }
-    glBindVertexArray(0);
+    unsigned int *index = *indices;
+    for (int z = 0; z + 1 < side; z++)
+    {
+        for (int x = 0; x + 1 < side; x++)
+        {
+            unsigned int corner = z * side + x;
+            *index++ = corner;
+            *index++ = corner + side;
+            *index++ = corner + 1;
+            *index++ = corner + 1;
+            *index++ = corner + side;
+            *index++ = corner + side + 1;
+        }
+    }
+    *indexCount = index - *indices;
+    return side * side;
 }
 
-void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX, float *angleY)
+// Builds a BVH over the triangles and casts rays at it from a sphere twice the size of the
+// bounds, each aimed at a random point inside the box so some of them miss
+void timeBVH(const char *name, const float *positions, int vertexCount, int stride, const unsigned int *indices,
+             int indexCount, int rays)
+{
+    BVH *bvh = buildBVH(positions, stride, indices, indexCount);
+    Bounds bounds = computeBounds(positions, vertexCount, stride);
+
+    Uint32 seed = 1;
+    float *rayData = malloc((size_t)rays * 6 * sizeof(float));
+    for (int i = 0; i < rays; i++)
+    {
+        float *origin = rayData + (size_t)i * 6, *dir = origin + 3;
+        float z = 2.0f * randomFloat(&seed) - 1.0f, phi = 2.0f * M_PI * randomFloat(&seed);
+        float r = sqrtf(1.0f - z * z);
+        float unit[3] = {r * cosf(phi), r * sinf(phi), z};
+        for (int k = 0; k < 3; k++)
+        {
+            origin[k] = bounds.center[k] + 2.0f * bounds.radius * unit[k];
+            dir[k] = bounds.min[k] + (bounds.max[k] - bounds.min[k]) * randomFloat(&seed) - origin[k];
+        }
+    }
+
+    int hits = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < rays; i++)
+    {
+        BVHHit hit;
+        hits += intersectBVH(bvh, rayData + (size_t)i * 6, rayData + (size_t)i * 6 + 3, FLT_MAX, &hit);
+    }
+    float seconds = (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+
+    int triangles = indexCount / 3;
+    printf("%-16s %8d triangles, %7d nodes, depth %2d, built in %8.2f ms (%5.2f Mtri/s), %.2f Mrays/s, %4.1f%% hit\n",
+           name, triangles, bvh->nodeCount, bvh->depth, bvh->buildTime, triangles / bvh->buildTime / 1e3f,
+           rays / seconds / 1e6f, 100.0f * hits / rays);
+    free(rayData);
+    destroyBVH(bvh);
+}
+
+// Build time and closest hit throughput of the BVH. Needs no GL.
+int runBVHBenchmark(int rays)
+{
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        printf("error initializing SDL: %s\n", SDL_GetError());
+        return 0;
+    }
+    printf("BVH: %d rays per mesh, %d CPUs for the build\n", rays, SDL_GetCPUCount());
+
+    Mesh helicopter = loadOBJ("models/Helicopter.obj", POS(0.0f, 0.0f, 0.0f), "cyan", 1.0f);
+    if (helicopter.indiceCount > 0)
+        timeBVH("Helicopter.obj", &helicopter.vertices[0].x, helicopter.vertexCount, sizeof(Vertex) / sizeof(float),
+                helicopter.indices, helicopter.indiceCount, rays);
+    destroyMesh(&helicopter);
+
+    for (int millions = 1; millions <= 4; millions *= 2)
+    {
+        // Two triangles per grid cell
+        int side = (int)ceilf(sqrtf(millions * 1e6f / 2.0f)) + 1;
+        float *positions;
+        unsigned int *indices;
+        int indexCount;
+        int vertexCount = syntheticTerrain(side, &positions, &indices, &indexCount);
+        char name[32];
+        snprintf(name, sizeof(name), "terrain %dM", millions);
+        timeBVH(name, positions, vertexCount, 3, indices, indexCount, rays);
+        free(positions);
+        free(indices);
+    }
+    SDL_Quit();
+    return 1;
+}
+
+// Scalar forms of the math3d kernels for --mathbench, kept out of line like the kernels they are measured against
+__attribute__((noinline)) void scalarMultiplyMatrices(Mat4x4 *result, const Mat4x4 *a, const Mat4x4 *b)
+{
+    Mat4x4 tmp;
+    for (int row = 0; row < 4; row++)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            tmp.m[row][col] = a->m[row][0] * b->m[0][col] + a->m[row][1] * b->m[1][col] +
+                              a->m[row][2] * b->m[2][col] + a->m[row][3] * b->m[3][col];
+        }
+    }
+    *result = tmp;
+}
+
+__attribute__((noinline)) void scalarMultiplyMatrixVec4(Vec4 *result, const Mat4x4 *mat, const Vec4 *vec)
+{
+    Vec4 v = *vec;
+    result->x = mat->m[0][0] * v.x + mat->m[0][1] * v.y + mat->m[0][2] * v.z + mat->m[0][3] * v.w;
+    result->y = mat->m[1][0] * v.x + mat->m[1][1] * v.y + mat->m[1][2] * v.z + mat->m[1][3] * v.w;
+    result->z = mat->m[2][0] * v.x + mat->m[2][1] * v.y + mat->m[2][2] * v.z + mat->m[2][3] * v.w;
+    result->w = mat->m[3][0] * v.x + mat->m[3][1] * v.y + mat->m[3][2] * v.z + mat->m[3][3] * v.w;
+}
+
+__attribute__((noinline)) void scalarTransformPositions(float *outX, float *outY, float *outZ, const Mat4x4 *mat,
+                                                        const float *x, const float *y, const float *z, int count)
+{
+    const float (*m)[4] = mat->m;
+    for (int i = 0; i < count; i++)
+    {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+        outY[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+        outZ[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
+    }
+}
+
+float nanosecondsSince(Uint64 start, long long ops)
+{
+    return (SDL_GetPerformanceCounter() - start) * 1e9f / SDL_GetPerformanceFrequency() / ops;
+}
+
+// Products are chained through a rotation so every op waits on the one before, like
+// the scene composing transforms. Positions are the software rasterizer's batch size.
+int runMathBenchmark(int iterations)
+{
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        printf("error initializing SDL: %s\n", SDL_GetError());
+        return 0;
+    }
+    Mat4x4 rotation = {0};
+    createRotationMatrix(&rotation, 0.1f, 0.2f, 0.3f);
+
+    Mat4x4 scalarMat = rotation, simdMat = rotation;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; i++)
+        scalarMultiplyMatrices(&scalarMat, &scalarMat, &rotation);
+    float scalarNs = nanosecondsSince(start, iterations);
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; i++)
+        multiplyMatricesPtr(&simdMat, &simdMat, &rotation);
+    float simdNs = nanosecondsSince(start, iterations);
+    printf("mat4 * mat4          %8.2f ns scalar, %8.2f ns SIMD\n", scalarNs, simdNs);
+
+    Vec4 scalarVec = {1.0f, 2.0f, 3.0f, 1.0f}, simdVec = scalarVec;
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; i++)
+        scalarMultiplyMatrixVec4(&scalarVec, &rotation, &scalarVec);
+    scalarNs = nanosecondsSince(start, iterations);
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; i++)
+        multiplyMatrixVec4(&simdVec, &rotation, &simdVec);
+    simdNs = nanosecondsSince(start, iterations);
+    printf("mat4 * vec4          %8.2f ns scalar, %8.2f ns SIMD\n", scalarNs, simdNs);
+
+    float x[SOFT_VERTEX_BATCH], y[SOFT_VERTEX_BATCH], z[SOFT_VERTEX_BATCH];
+    for (int i = 0; i < SOFT_VERTEX_BATCH; i++)
+    {
+        x[i] = (float)i;
+        y[i] = 1.0f;
+        z[i] = -(float)i;
+    }
+    int rounds = iterations / SOFT_VERTEX_BATCH > 0 ? iterations / SOFT_VERTEX_BATCH : 1;
+    long long points = (long long)rounds * SOFT_VERTEX_BATCH;
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < rounds; i++)
+        scalarTransformPositions(x, y, z, &rotation, x, y, z, SOFT_VERTEX_BATCH);
+    scalarNs = nanosecondsSince(start, points);
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < rounds; i++)
+        transformPositionsSoA(x, y, z, &rotation, x, y, z, SOFT_VERTEX_BATCH);
+    simdNs = nanosecondsSince(start, points);
+    printf("position transform   %8.2f ns scalar, %8.2f ns SIMD, per point\n", scalarNs, simdNs);
+
+    // Printed so the chains cannot be optimised away, the two forms should agree
+    printf("Check: %.4f %.4f, %.4f %.4f, %.4f\n", scalarMat.m[0][0], simdMat.m[0][0], scalarVec.x, simdVec.x, x[1]);
+    SDL_Quit();
+    return 1;
+}
+
+// Place of monkey i in a cube of count monkeys behind the regular scene,
+// turned and coloured by its place in the grid
+Transform stressTransform(int i, int count, float *color)
+{
+    int side = (int)ceilf(cbrtf((float)count));
+    float spacing = 2.5f;
+    float half = (side - 1) * spacing * 0.5f;
+    int x = i % side, y = (i / side) % side, z = i / (side * side);
+    float position[3] = {x * spacing - half, y * spacing - half, z * spacing - 2.0f * half - 4.0f};
+    Transform transform = createTransform(position, 1.0f);
+    transform.rotation = quatFromAxisAngle(0.0f, 1.0f, 0.0f, i * 0.37f);
+    color[0] = (float)x / side;
+    color[1] = (float)y / side;
+    color[2] = 1.0f - (float)z / side;
+    return transform;
+}
+
+// Waits up to waitMs for the first event when waitMs is not 0. Anything that
+// changes what is drawn marks the frame dirty.
+void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, Quat *orientation, int waitMs)
 {
     wm->eh->zoom = 0;
     wm->eh->mouseMotionX = 0;
     wm->eh->mouseMotionY = 0;
 
-    while (SDL_PollEvent(&(wm->eh->event)))
+    int pending = waitMs > 0 ? SDL_WaitEventTimeout(&(wm->eh->event), waitMs) : SDL_PollEvent(&(wm->eh->event));
+    for (; pending; pending = SDL_PollEvent(&(wm->eh->event)))
     {
         switch (wm->eh->event.type)
         {
@@ -144,7 +1206,13 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
             wm->eh->running = 0;
             break;
 
+        case SDL_WINDOWEVENT:
+            // Exposed, resized, restored and the like all need the window drawn again
+            wm->eh->dirty = 1;
+            break;
+
         case SDL_KEYDOWN:
+            wm->eh->dirty = 1;
             if (wm->eh->event.key.keysym.sym == SDLK_F11)
             {
                 toggleFullscreen(wm);
@@ -157,6 +1225,22 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
             {
                 wm->eh->n = (wm->eh->n + 1) % 4;
             }
+            if (wm->eh->event.key.keysym.sym == SDLK_m)
+            {
+                wm->eh->multiDraw = !wm->eh->multiDraw;
+            }
+            if (wm->eh->event.key.keysym.sym == SDLK_c)
+            {
+                wm->eh->capture = !wm->eh->capture;
+            }
+            if (wm->eh->event.key.keysym.sym == SDLK_p)
+            {
+                wm->eh->profile = !wm->eh->profile;
+            }
+            if (wm->eh->event.key.keysym.sym == SDLK_t)
+            {
+                wm->eh->writeTrace = 1;
+            }
             if (wm->eh->event.key.keysym.sym == SDLK_LSHIFT)
             {
                 wm->eh->shift = 1;
@@ -170,9 +1254,16 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
             break;
 
         case SDL_MOUSEBUTTONDOWN:
+            wm->eh->dirty = 1;
             wm->eh->mouseDown = 1;
             if (wm->eh->event.button.button == SDL_BUTTON_LEFT)
                 wm->eh->mouseMiddle = 1;
+            if (wm->eh->event.button.button == SDL_BUTTON_RIGHT)
+            {
+                wm->eh->pick = 1;
+                wm->eh->pickX = wm->eh->event.button.x;
+                wm->eh->pickY = wm->eh->event.button.y;
+            }
             break;
         case SDL_MOUSEBUTTONUP:
             wm->eh->mouseDown = 0;
@@ -181,6 +1272,7 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
             break;
 
         case SDL_MOUSEWHEEL:
+            wm->eh->dirty = 1;
             if (wm->eh->event.wheel.y > 0)
             {
                 wm->eh->zoom = 1; // Zoom in
@@ -194,6 +1286,9 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
         case SDL_MOUSEMOTION:
             wm->eh->mouseMotionX = wm->eh->event.motion.xrel;
             wm->eh->mouseMotionY = wm->eh->event.motion.yrel;
+            // Only dragging moves the camera
+            if (wm->eh->mouseDown)
+                wm->eh->dirty = 1;
             break;
         }
     }
@@ -214,8 +1309,10 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
             else
             {
                 // Orbit
-                *angleX += -wm->eh->mouseMotionY * sensitivity;
-                *angleY += -wm->eh->mouseMotionX * sensitivity;
+                Quat pitch = quatFromAxisAngle(1.0f, 0.0f, 0.0f, wm->eh->mouseMotionY * sensitivity);
+                Quat yaw = quatFromAxisAngle(0.0f, 1.0f, 0.0f, wm->eh->mouseMotionX * sensitivity);
+                *orientation = quatNormalize(quatMultiply(quatMultiply(yaw, pitch), *orientation));
+                wm->cam->modelDirty = 1;
             }
         }
     }
@@ -230,6 +1327,31 @@ void getWindowEvents(WindowModel *wm, Vertex *eye, Vertex *target, float *angleX
     }
 }
 
+void pickUnderCursor(WindowModel *wm, Mesh *meshes, int meshCount)
+{
+    int width, height;
+    SDL_GetWindowSize(wm->win, &width, &height);
+
+    float origin[3], dir[3];
+    screenRay(&wm->cam->model, &wm->cam->view, &wm->cam->projection,
+              wm->eh->pickX + 0.5f, wm->eh->pickY + 0.5f, width, height, origin, dir);
+
+    PickResult hit;
+    Uint64 start = SDL_GetPerformanceCounter();
+    int found = pickMesh(meshes, meshCount, origin, dir, &hit);
+    float ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+
+    if (found)
+    {
+        printf("Picked mesh %d, triangle %d at (%.3f, %.3f, %.3f) in %.3f ms\n",
+               hit.mesh, hit.triangle, hit.position[0], hit.position[1], hit.position[2], ms);
+    }
+    else
+    {
+        printf("Nothing under the cursor (%.3f ms)\n", ms);
+    }
+}
+
 void toggleFullscreen(WindowModel *wm)
 {
     wm->eh->fullScreen = !wm->eh->fullScreen;
@@ -291,4 +1413,26 @@ int initializeWindow(WindowModel *wm)
 
     printf("OpenGL version: %s\n", glGetString(GL_VERSION));
     return 1;
+}
+
+// No window and no display, only the timer subsystem for the frame times
+int initializeHeadless(WindowModel *wm, Headless *hl)
+{
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        printf("error initializing SDL: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    wm->win = NULL;
+    wm->glContext = NULL;
+    if (!createHeadless(hl, SW, SH))
+    {
+        SDL_Quit();
+        return 0;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    printf("OpenGL version: %s (headless)\n", glGetString(GL_VERSION));
+    return 1;
 }
\ No newline at end of file
@@ -1,66 +1,410 @@
 #include <stdio.h>
 #include "math3d.h"
 
-Vertex normalize(Vertex v) {
-    float magnitude = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-    Vertex normalized = { v.x / magnitude, v.y / magnitude, v.z / magnitude };
-    return normalized;
-}
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MATH3D_AVX
+#define MATH3D_SSE
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MATH3D_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MATH3D_NEON
+#endif
+
+#ifdef __FMA__
+#define MADD(a, b, c)    _mm_fmadd_ps(a, b, c)
+#define MADD256(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define MADD(a, b, c)    _mm_add_ps(_mm_mul_ps(a, b), c)
+#define MADD256(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
 
-Vertex subtractVec3d(Vertex v1, Vertex v2) {
-    Vertex result = {v1.x - v2.x, v1.y - v2.y, v1.z - v2.z};
+Mat4x4 multiplyMatrices(Mat4x4 a, Mat4x4 b) {
+    Mat4x4 result;
+    multiplyMatricesPtr(&result, &a, &b);
     return result;
 }
 
-float dotProduct(Vertex v1, Vertex v2) {
-    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+// result[i] = dot(mat row i, vec)
+void multiplyMatrixVec4(Vec4 *result, const Mat4x4 *mat, const Vec4 *vec) {
+#if defined(MATH3D_SSE)
+    // The transpose only depends on the matrix, so it stays off the vector's dependency chain
+    __m128 c0 = _mm_loadu_ps(mat->m[0]), c1 = _mm_loadu_ps(mat->m[1]);
+    __m128 c2 = _mm_loadu_ps(mat->m[2]), c3 = _mm_loadu_ps(mat->m[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 v = _mm_load_ps(&vec->x);
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(v, v, 0x00), c0), _mm_mul_ps(_mm_shuffle_ps(v, v, 0x55), c1));
+    r = _mm_add_ps(r, _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(v, v, 0xAA), c2), _mm_mul_ps(_mm_shuffle_ps(v, v, 0xFF), c3)));
+    _mm_store_ps(&result->x, r);
+#elif defined(MATH3D_NEON)
+    float32x4x4_t cols = vld4q_f32(&mat->m[0][0]);
+    float32x4_t r = vmulq_n_f32(cols.val[0], vec->x);
+    r = vmlaq_n_f32(r, cols.val[1], vec->y);
+    r = vmlaq_n_f32(r, cols.val[2], vec->z);
+    vst1q_f32(&result->x, vmlaq_n_f32(r, cols.val[3], vec->w));
+#else
+    Vec4 v = *vec;
+    result->x = mat->m[0][0] * v.x + mat->m[0][1] * v.y + mat->m[0][2] * v.z + mat->m[0][3] * v.w;
+    result->y = mat->m[1][0] * v.x + mat->m[1][1] * v.y + mat->m[1][2] * v.z + mat->m[1][3] * v.w;
+    result->z = mat->m[2][0] * v.x + mat->m[2][1] * v.y + mat->m[2][2] * v.z + mat->m[2][3] * v.w;
+    result->w = mat->m[3][0] * v.x + mat->m[3][1] * v.y + mat->m[3][2] * v.z + mat->m[3][3] * v.w;
+#endif
 }
 
-Mat4x4 multiplyMatrices(Mat4x4 a, Mat4x4 b) {
-    Mat4x4 result = {0};
+Vertex multiplyMatrixVector(Mat4x4 mat, Vertex vec) {
+    Vec4 in = {vec.x, vec.y, vec.z, 1.0f}, out;
+    multiplyMatrixVec4(&out, &mat, &in);
+    Vertex result = {.x = out.x, .y = out.y, .z = out.z};
+    if (out.w != 0.0f) {
+        result.x /= out.w;
+        result.y /= out.w;
+        result.z /= out.w;
+    }
+    return result;
+}
+
+// result = a * b, result may point to a or b
+void multiplyMatricesPtr(Mat4x4 *result, const Mat4x4 *a, const Mat4x4 *b) {
+#if defined(MATH3D_AVX)
+    __m256 b0 = _mm256_broadcast_ps((const __m128 *)b->m[0]);
+    __m256 b1 = _mm256_broadcast_ps((const __m128 *)b->m[1]);
+    __m256 b2 = _mm256_broadcast_ps((const __m128 *)b->m[2]);
+    __m256 b3 = _mm256_broadcast_ps((const __m128 *)b->m[3]);
+    __m256 rows[2];
+    for (int i = 0; i < 2; i++) {
+        // Two rows of a per register, each element broadcast within its half
+        __m256 ar = _mm256_loadu_ps(a->m[i * 2]);
+        __m256 r = _mm256_mul_ps(_mm256_permute_ps(ar, 0x00), b0);
+        r = MADD256(_mm256_permute_ps(ar, 0x55), b1, r);
+        r = MADD256(_mm256_permute_ps(ar, 0xAA), b2, r);
+        rows[i] = MADD256(_mm256_permute_ps(ar, 0xFF), b3, r);
+    }
+    _mm256_storeu_ps(result->m[0], rows[0]);
+    _mm256_storeu_ps(result->m[2], rows[1]);
+#elif defined(MATH3D_SSE)
+    __m128 b0 = _mm_loadu_ps(b->m[0]), b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]), b3 = _mm_loadu_ps(b->m[3]);
+    __m128 rows[4];
+    for (int i = 0; i < 4; i++) {
+        __m128 ar = _mm_loadu_ps(a->m[i]);
+        __m128 r = _mm_mul_ps(_mm_shuffle_ps(ar, ar, 0x00), b0);
+        r = MADD(_mm_shuffle_ps(ar, ar, 0x55), b1, r);
+        r = MADD(_mm_shuffle_ps(ar, ar, 0xAA), b2, r);
+        rows[i] = MADD(_mm_shuffle_ps(ar, ar, 0xFF), b3, r);
+    }
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_ps(result->m[i], rows[i]);
+    }
+#elif defined(MATH3D_NEON)
+    float32x4_t b0 = vld1q_f32(b->m[0]), b1 = vld1q_f32(b->m[1]);
+    float32x4_t b2 = vld1q_f32(b->m[2]), b3 = vld1q_f32(b->m[3]);
+    float32x4_t rows[4];
+    for (int i = 0; i < 4; i++) {
+        float32x4_t r = vmulq_n_f32(b0, a->m[i][0]);
+        r = vmlaq_n_f32(r, b1, a->m[i][1]);
+        r = vmlaq_n_f32(r, b2, a->m[i][2]);
+        rows[i] = vmlaq_n_f32(r, b3, a->m[i][3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        vst1q_f32(result->m[i], rows[i]);
+    }
+#else
+    Mat4x4 tmp;
     for (int row = 0; row < 4; row++) {
         for (int col = 0; col < 4; col++) {
-            result.m[row][col] = a.m[row][0] * b.m[0][col] +
-                                 a.m[row][1] * b.m[1][col] +
-                                 a.m[row][2] * b.m[2][col] +
-                                 a.m[row][3] * b.m[3][col];
+            tmp.m[row][col] = a->m[row][0] * b->m[0][col] +
+                              a->m[row][1] * b->m[1][col] +
+                              a->m[row][2] * b->m[2][col] +
+                              a->m[row][3] * b->m[3][col];
         }
     }
-    return result;
+    *result = tmp;
+#endif
 }
 
-Vertex multiplyMatrixVector(Mat4x4 mat, Vertex vec) {
-    Vertex result = {
-        .x = mat.m[0][0] * vec.x + mat.m[0][1] * vec.y + mat.m[0][2] * vec.z + mat.m[0][3],
-        .y = mat.m[1][0] * vec.x + mat.m[1][1] * vec.y + mat.m[1][2] * vec.z + mat.m[1][3],
-        .z = mat.m[2][0] * vec.x + mat.m[2][1] * vec.y + mat.m[2][2] * vec.z + mat.m[2][3]
-    };
-    float w = mat.m[3][0] * vec.x + mat.m[3][1] * vec.y + mat.m[3][2] * vec.z + mat.m[3][3];
-    if (w != 0.0f) {
-        result.x /= w;
-        result.y /= w;
-        result.z /= w;
+// Positions stored as separate x, y and z arrays, transformed eight at a time.
+// Columns of the matrix are contiguous like everywhere else in the renderer, w = 1
+// and only the top three rows are used. Sums run in the same order as the scalar
+// loops, translation last. The output arrays may be the input arrays.
+void transformPositionsSoA(float *outX, float *outY, float *outZ, const Mat4x4 *mat, const float *x, const float *y, const float *z, int count) {
+    const float (*m)[4] = mat->m;
+    int i = 0;
+#if defined(MATH3D_AVX)
+    __m256 m00 = _mm256_set1_ps(m[0][0]), m10 = _mm256_set1_ps(m[1][0]), m20 = _mm256_set1_ps(m[2][0]), m30 = _mm256_set1_ps(m[3][0]);
+    __m256 m01 = _mm256_set1_ps(m[0][1]), m11 = _mm256_set1_ps(m[1][1]), m21 = _mm256_set1_ps(m[2][1]), m31 = _mm256_set1_ps(m[3][1]);
+    __m256 m02 = _mm256_set1_ps(m[0][2]), m12 = _mm256_set1_ps(m[1][2]), m22 = _mm256_set1_ps(m[2][2]), m32 = _mm256_set1_ps(m[3][2]);
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        __m256 rx = _mm256_add_ps(MADD256(m20, pz, MADD256(m10, py, _mm256_mul_ps(m00, px))), m30);
+        __m256 ry = _mm256_add_ps(MADD256(m21, pz, MADD256(m11, py, _mm256_mul_ps(m01, px))), m31);
+        __m256 rz = _mm256_add_ps(MADD256(m22, pz, MADD256(m12, py, _mm256_mul_ps(m02, px))), m32);
+        _mm256_storeu_ps(outX + i, rx);
+        _mm256_storeu_ps(outY + i, ry);
+        _mm256_storeu_ps(outZ + i, rz);
+    }
+#elif defined(MATH3D_SSE)
+    __m128 m00 = _mm_set1_ps(m[0][0]), m10 = _mm_set1_ps(m[1][0]), m20 = _mm_set1_ps(m[2][0]), m30 = _mm_set1_ps(m[3][0]);
+    __m128 m01 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m21 = _mm_set1_ps(m[2][1]), m31 = _mm_set1_ps(m[3][1]);
+    __m128 m02 = _mm_set1_ps(m[0][2]), m12 = _mm_set1_ps(m[1][2]), m22 = _mm_set1_ps(m[2][2]), m32 = _mm_set1_ps(m[3][2]);
+    for (; i + 8 <= count; i += 8) {
+        for (int h = i; h < i + 8; h += 4) {
+            __m128 px = _mm_loadu_ps(x + h), py = _mm_loadu_ps(y + h), pz = _mm_loadu_ps(z + h);
+            __m128 rx = _mm_add_ps(MADD(m20, pz, MADD(m10, py, _mm_mul_ps(m00, px))), m30);
+            __m128 ry = _mm_add_ps(MADD(m21, pz, MADD(m11, py, _mm_mul_ps(m01, px))), m31);
+            __m128 rz = _mm_add_ps(MADD(m22, pz, MADD(m12, py, _mm_mul_ps(m02, px))), m32);
+            _mm_storeu_ps(outX + h, rx);
+            _mm_storeu_ps(outY + h, ry);
+            _mm_storeu_ps(outZ + h, rz);
+        }
+    }
+#elif defined(MATH3D_NEON)
+    for (; i + 8 <= count; i += 8) {
+        for (int h = i; h < i + 8; h += 4) {
+            float32x4_t px = vld1q_f32(x + h), py = vld1q_f32(y + h), pz = vld1q_f32(z + h);
+            float32x4_t rx = vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][0]), py, m[1][0]), pz, m[2][0]), vdupq_n_f32(m[3][0]));
+            float32x4_t ry = vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][1]), py, m[1][1]), pz, m[2][1]), vdupq_n_f32(m[3][1]));
+            float32x4_t rz = vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][2]), py, m[1][2]), pz, m[2][2]), vdupq_n_f32(m[3][2]));
+            vst1q_f32(outX + h, rx);
+            vst1q_f32(outY + h, ry);
+            vst1q_f32(outZ + h, rz);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+        outY[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+        outZ[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
     }
-    return result;
 }
 
-Vertex crossProduct(Vertex v1, Vertex v2) {
-    Vertex cross = {
-        v1.y * v2.z - v1.z * v2.y,
-        v1.z * v2.x - v1.x * v2.z,
-        v1.x * v2.y - v1.y * v2.x
-    };
-    return cross;
+// Like transformPositionsSoA but with all four rows, for clip space positions.
+// There is no divide, clipping against the frustum still needs w.
+void projectPositionsSoA(float *outX, float *outY, float *outZ, float *outW, const Mat4x4 *mat, const float *x, const float *y, const float *z, int count) {
+    const float (*m)[4] = mat->m;
+    int i = 0;
+#if defined(MATH3D_AVX)
+    __m256 m00 = _mm256_set1_ps(m[0][0]), m10 = _mm256_set1_ps(m[1][0]), m20 = _mm256_set1_ps(m[2][0]), m30 = _mm256_set1_ps(m[3][0]);
+    __m256 m01 = _mm256_set1_ps(m[0][1]), m11 = _mm256_set1_ps(m[1][1]), m21 = _mm256_set1_ps(m[2][1]), m31 = _mm256_set1_ps(m[3][1]);
+    __m256 m02 = _mm256_set1_ps(m[0][2]), m12 = _mm256_set1_ps(m[1][2]), m22 = _mm256_set1_ps(m[2][2]), m32 = _mm256_set1_ps(m[3][2]);
+    __m256 m03 = _mm256_set1_ps(m[0][3]), m13 = _mm256_set1_ps(m[1][3]), m23 = _mm256_set1_ps(m[2][3]), m33 = _mm256_set1_ps(m[3][3]);
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        _mm256_storeu_ps(outX + i, _mm256_add_ps(MADD256(m20, pz, MADD256(m10, py, _mm256_mul_ps(m00, px))), m30));
+        _mm256_storeu_ps(outY + i, _mm256_add_ps(MADD256(m21, pz, MADD256(m11, py, _mm256_mul_ps(m01, px))), m31));
+        _mm256_storeu_ps(outZ + i, _mm256_add_ps(MADD256(m22, pz, MADD256(m12, py, _mm256_mul_ps(m02, px))), m32));
+        _mm256_storeu_ps(outW + i, _mm256_add_ps(MADD256(m23, pz, MADD256(m13, py, _mm256_mul_ps(m03, px))), m33));
+    }
+#elif defined(MATH3D_SSE)
+    __m128 m00 = _mm_set1_ps(m[0][0]), m10 = _mm_set1_ps(m[1][0]), m20 = _mm_set1_ps(m[2][0]), m30 = _mm_set1_ps(m[3][0]);
+    __m128 m01 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m21 = _mm_set1_ps(m[2][1]), m31 = _mm_set1_ps(m[3][1]);
+    __m128 m02 = _mm_set1_ps(m[0][2]), m12 = _mm_set1_ps(m[1][2]), m22 = _mm_set1_ps(m[2][2]), m32 = _mm_set1_ps(m[3][2]);
+    __m128 m03 = _mm_set1_ps(m[0][3]), m13 = _mm_set1_ps(m[1][3]), m23 = _mm_set1_ps(m[2][3]), m33 = _mm_set1_ps(m[3][3]);
+    for (; i + 8 <= count; i += 8) {
+        for (int h = i; h < i + 8; h += 4) {
+            __m128 px = _mm_loadu_ps(x + h), py = _mm_loadu_ps(y + h), pz = _mm_loadu_ps(z + h);
+            _mm_storeu_ps(outX + h, _mm_add_ps(MADD(m20, pz, MADD(m10, py, _mm_mul_ps(m00, px))), m30));
+            _mm_storeu_ps(outY + h, _mm_add_ps(MADD(m21, pz, MADD(m11, py, _mm_mul_ps(m01, px))), m31));
+            _mm_storeu_ps(outZ + h, _mm_add_ps(MADD(m22, pz, MADD(m12, py, _mm_mul_ps(m02, px))), m32));
+            _mm_storeu_ps(outW + h, _mm_add_ps(MADD(m23, pz, MADD(m13, py, _mm_mul_ps(m03, px))), m33));
+        }
+    }
+#elif defined(MATH3D_NEON)
+    for (; i + 8 <= count; i += 8) {
+        for (int h = i; h < i + 8; h += 4) {
+            float32x4_t px = vld1q_f32(x + h), py = vld1q_f32(y + h), pz = vld1q_f32(z + h);
+            vst1q_f32(outX + h, vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][0]), py, m[1][0]), pz, m[2][0]), vdupq_n_f32(m[3][0])));
+            vst1q_f32(outY + h, vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][1]), py, m[1][1]), pz, m[2][1]), vdupq_n_f32(m[3][1])));
+            vst1q_f32(outZ + h, vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][2]), py, m[1][2]), pz, m[2][2]), vdupq_n_f32(m[3][2])));
+            vst1q_f32(outW + h, vaddq_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(px, m[0][3]), py, m[1][3]), pz, m[2][3]), vdupq_n_f32(m[3][3])));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+        outY[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+        outZ[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
+        outW[i] = m[0][3] * px + m[1][3] * py + m[2][3] * pz + m[3][3];
+    }
+}
+
+#ifdef MATH3D_SSE
+#define SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+#define SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+// 2x2 matrices packed row by row into one register
+static inline __m128 mat2Mul(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adjugate(a) * b
+static inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// a * adjugate(b)
+static inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+static inline __m128 cross3(__m128 a, __m128 b) {
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 1, 2, 0, 3)), _mm_mul_ps(SWIZZLE(a, 1, 2, 0, 3), b));
+    return SWIZZLE(c, 1, 2, 0, 3);
+}
+#endif
+
+// General inverse. Returns 0 and leaves result untouched when mat is singular.
+int invertMatrix(Mat4x4 *result, const Mat4x4 *mat) {
+#ifdef MATH3D_SSE
+    // Block-wise inverse over the four 2x2 sub matrices
+    __m128 r0 = _mm_loadu_ps(mat->m[0]), r1 = _mm_loadu_ps(mat->m[1]);
+    __m128 r2 = _mm_loadu_ps(mat->m[2]), r3 = _mm_loadu_ps(mat->m[3]);
+    __m128 A = _mm_movelh_ps(r0, r1), B = _mm_movehl_ps(r1, r0);
+    __m128 C = _mm_movelh_ps(r2, r3), D = _mm_movehl_ps(r3, r2);
+
+    __m128 detSub = _mm_sub_ps(_mm_mul_ps(SHUFFLE(r0, r2, 0, 2, 0, 2), SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                               _mm_mul_ps(SHUFFLE(r0, r2, 1, 3, 1, 3), SHUFFLE(r1, r3, 0, 2, 0, 2)));
+    __m128 detA = SWIZZLE(detSub, 0, 0, 0, 0), detB = SWIZZLE(detSub, 1, 1, 1, 1);
+    __m128 detC = SWIZZLE(detSub, 2, 2, 2, 2), detD = SWIZZLE(detSub, 3, 3, 3, 3);
+
+    __m128 DC = mat2AdjMul(D, C);
+    __m128 AB = mat2AdjMul(A, B);
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, DC));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, AB));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, AB));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, DC));
+
+    __m128 tr = _mm_mul_ps(AB, SWIZZLE(DC, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, _mm_movehl_ps(tr, tr));
+    tr = _mm_add_ss(tr, SWIZZLE(tr, 1, 1, 1, 1));
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), SWIZZLE(tr, 0, 0, 0, 0));
+    if (_mm_cvtss_f32(det) == 0.0f) return 0;
+
+    __m128 invDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    X = _mm_mul_ps(X, invDet);
+    Y = _mm_mul_ps(Y, invDet);
+    Z = _mm_mul_ps(Z, invDet);
+    W = _mm_mul_ps(W, invDet);
+
+    _mm_storeu_ps(result->m[0], SHUFFLE(X, Y, 3, 1, 3, 1));
+    _mm_storeu_ps(result->m[1], SHUFFLE(X, Y, 2, 0, 2, 0));
+    _mm_storeu_ps(result->m[2], SHUFFLE(Z, W, 3, 1, 3, 1));
+    _mm_storeu_ps(result->m[3], SHUFFLE(Z, W, 2, 0, 2, 0));
+    return 1;
+#else
+    // Cofactor expansion
+    const float *m = &mat->m[0][0];
+    float inv[16];
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0.0f) return 0;
+    det = 1.0f / det;
+    for (int i = 0; i < 16; i++) {
+        result->m[i / 4][i % 4] = inv[i] * det;
+    }
+    return 1;
+#endif
+}
+
+// Inverse of a rotation/scale/shear plus translation, as built for model matrices
+// (translation in m[3], m[0..2][3] zero). Returns 0 when the 3x3 part is singular.
+int invertAffineMatrix(Mat4x4 *result, const Mat4x4 *mat) {
+#ifdef MATH3D_SSE
+    __m128 r0 = _mm_loadu_ps(mat->m[0]), r1 = _mm_loadu_ps(mat->m[1]), r2 = _mm_loadu_ps(mat->m[2]);
+    __m128 t = _mm_loadu_ps(mat->m[3]);
+
+    // Inverse of a 3x3 with rows r0..r2 has the cross products as columns
+    __m128 c0 = cross3(r1, r2), c1 = cross3(r2, r0), c2 = cross3(r0, r1);
+    __m128 d = _mm_mul_ps(r0, c0);
+    float det = _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(d, SWIZZLE(d, 1, 1, 1, 1)), SWIZZLE(d, 2, 2, 2, 2)));
+    if (det == 0.0f) return 0;
+
+    __m128 invDet = _mm_set1_ps(1.0f / det);
+    __m128 i0 = _mm_mul_ps(c0, invDet), i1 = _mm_mul_ps(c1, invDet), i2 = _mm_mul_ps(c2, invDet);
+    __m128 i3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+
+    // New translation is -t * inverse, w back to one
+    __m128 nt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(SWIZZLE(t, 0, 0, 0, 0), i0), _mm_mul_ps(SWIZZLE(t, 1, 1, 1, 1), i1)),
+                           _mm_mul_ps(SWIZZLE(t, 2, 2, 2, 2), i2));
+    nt = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), nt);
+
+    _mm_storeu_ps(result->m[0], i0);
+    _mm_storeu_ps(result->m[1], i1);
+    _mm_storeu_ps(result->m[2], i2);
+    _mm_storeu_ps(result->m[3], nt);
+    return 1;
+#else
+    const float (*m)[4] = mat->m;
+    Mat3x3 n;
+    if (!normalMatrix(&n, mat)) return 0;
+
+    // The normal matrix is the transposed inverse
+    Mat4x4 inv;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            inv.m[i][j] = n.m[j][i];
+        }
+        inv.m[i][3] = 0.0f;
+    }
+    for (int j = 0; j < 3; j++) {
+        inv.m[3][j] = -(m[3][0] * inv.m[0][j] + m[3][1] * inv.m[1][j] + m[3][2] * inv.m[2][j]);
+    }
+    inv.m[3][3] = 1.0f;
+    *result = inv;
+    return 1;
+#endif
+}
+
+// Inverse transpose of the model's upper 3x3, column by column for glUniformMatrix3fv.
+// With the columns of the inverse being cross products, this is just those products.
+int normalMatrix(Mat3x3 *result, const Mat4x4 *model) {
+    const float (*m)[4] = model->m;
+    float c0[3] = {m[1][1] * m[2][2] - m[1][2] * m[2][1], m[1][2] * m[2][0] - m[1][0] * m[2][2], m[1][0] * m[2][1] - m[1][1] * m[2][0]};
+    float c1[3] = {m[2][1] * m[0][2] - m[2][2] * m[0][1], m[2][2] * m[0][0] - m[2][0] * m[0][2], m[2][0] * m[0][1] - m[2][1] * m[0][0]};
+    float c2[3] = {m[0][1] * m[1][2] - m[0][2] * m[1][1], m[0][2] * m[1][0] - m[0][0] * m[1][2], m[0][0] * m[1][1] - m[0][1] * m[1][0]};
+    float det = m[0][0] * c0[0] + m[0][1] * c0[1] + m[0][2] * c0[2];
+    if (det == 0.0f) return 0;
+    det = 1.0f / det;
+    for (int j = 0; j < 3; j++) {
+        result->m[0][j] = c0[j] * det;
+        result->m[1][j] = c1[j] * det;
+        result->m[2][j] = c2[j] * det;
+    }
+    return 1;
+}
+
+void transposeMatrix(Mat4x4 *result, const Mat4x4 *mat) {
+    Mat4x4 tmp;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            tmp.m[i][j] = mat->m[j][i];
+        }
+    }
+    *result = tmp;
 }
 
 void createPerspectiveProjection(Mat4x4 *mat, float fov, float aspect, float zNear, float zFar) {
-    float tanHalfFov = tanf(fov / 2.0f);
-    mat->m[0][0] = 1.0f / (aspect * tanHalfFov);
-    mat->m[1][1] = 1.0f / tanHalfFov;
-    mat->m[2][2] = -(zFar + zNear) / (zFar - zNear);
-    mat->m[2][3] = -1.0f;
-    mat->m[3][2] = -(2.0f * zFar * zNear) / (zFar - zNear);
-    mat->m[3][3] = 0.0f;
+    *mat = perspectiveMatrix(fov, aspect, zNear, zFar);
 }
 
 void createRotationMatrix(Mat4x4* model, float angleX, float angleY, float angleZ) {
@@ -94,18 +438,29 @@ void lookAt(Mat4x4* view, Vertex eye, Vertex target, Vertex up) {
     view->m[3][3] = 1.0f;
 }
 
-void setupMatrices(Mat4x4 *model, Mat4x4 *view, Mat4x4 *projection, unsigned int shaderProgram, Vertex eye, Vertex target, Vertex up) {
-    // Setup matrices (e.g., create rotation, translation, and projection)
-    createPerspectiveProjection(projection, M_PI / 4.0f, aspectRatio, 0.1f, 1000.0f);
+// Ray through pixel (x, y) in the space of the model matrix. The view has to be a
+// rigid lookAt transform, the model a pure rotation and the projection perspective.
+void screenRay(const Mat4x4 *model, const Mat4x4 *view, const Mat4x4 *projection, float x, float y, int width, int height, float *origin, float *dir) {
+    float ndcX = 2.0f * x / width - 1.0f;
+    float ndcY = 1.0f - 2.0f * y / height;
+    float viewDir[3] = {ndcX / projection->m[0][0], ndcY / projection->m[1][1], -1.0f};
 
-    lookAt(view, eye, target, up);
-    
-    unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
-    unsigned int viewLoc = glGetUniformLocation(shaderProgram, "view");
-    unsigned int projLoc = glGetUniformLocation(shaderProgram, "projection");
+    // The rows of the view rotation are the camera axes
+    float worldDir[3], worldEye[3];
+    for (int i = 0; i < 3; i++) {
+        worldDir[i] = view->m[i][0] * viewDir[0] + view->m[i][1] * viewDir[1] + view->m[i][2] * viewDir[2];
+        worldEye[i] = -(view->m[i][0] * view->m[3][0] + view->m[i][1] * view->m[3][1] + view->m[i][2] * view->m[3][2]);
+    }
 
-    // Send matrices to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model->m[0][0]);
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view->m[0][0]);
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection->m[0][0]);
-}
\ No newline at end of file
+    // Undo the model rotation with its transpose
+    float length = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        origin[i] = model->m[i][0] * worldEye[0] + model->m[i][1] * worldEye[1] + model->m[i][2] * worldEye[2];
+        dir[i] = model->m[i][0] * worldDir[0] + model->m[i][1] * worldDir[1] + model->m[i][2] * worldDir[2];
+        length += dir[i] * dir[i];
+    }
+    length = sqrtf(length);
+    for (int i = 0; i < 3; i++) {
+        dir[i] /= length;
+    }
+}
@@ -4,7 +4,6 @@
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 #include <math.h>
-#include "mesh.h"
 
 #define res         4               // 0=160*X 1=360*X 4=640*X ...
 #define aspectRatio (16.0f / 9.0f)
@@ -14,25 +13,60 @@
 #define SW2         SW/2
 #define FPS         60  
 #define sensitivity 0.01f
+#define FOV         (M_PI / 4.0f)
+#define Z_NEAR      0.1f
+#define Z_FAR       1000.0f
+
+typedef struct vertex {
+    float x, y, z;
+    float r, g, b;
+    float nx, ny, nz;
+} Vertex;
 
 typedef struct vec3d {
     float x, y, z;
 } Vec3d;
 
+typedef struct vec4 {
+    float x, y, z, w;
+} __attribute__((aligned(16))) Vec4;
+
 typedef struct mat4x4 {
     float m[4][4];
 } Mat4x4;
 
-Vertex normalize(Vertex v);
-Vertex subtractVec3d(Vertex v1, Vertex v2);
-float dotProduct(Vertex v1, Vertex v2);
+typedef struct mat3x3 {
+    float m[3][3];
+} Mat3x3;
+
+#include "math3d_inline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 Mat4x4 multiplyMatrices(Mat4x4 a, Mat4x4 b);
 Vertex multiplyMatrixVector(Mat4x4 mat, Vertex vec);
-Vertex crossProduct(Vertex v1, Vertex v2);
 
-void setupMatrices(Mat4x4 *model, Mat4x4 *view, Mat4x4 *projection, unsigned int shaderProgram, Vertex eye, Vertex target, Vertex up);
+// SIMD kernels, same conventions as multiplyMatrices and multiplyMatrixVector
+void multiplyMatricesPtr(Mat4x4 *result, const Mat4x4 *a, const Mat4x4 *b);
+void multiplyMatrixVec4(Vec4 *result, const Mat4x4 *mat, const Vec4 *vec);
+void transposeMatrix(Mat4x4 *result, const Mat4x4 *mat);
+int invertMatrix(Mat4x4 *result, const Mat4x4 *mat);
+int invertAffineMatrix(Mat4x4 *result, const Mat4x4 *mat);
+int normalMatrix(Mat3x3 *result, const Mat4x4 *model);
+
+// Column major like the matrices handed to GL, for the CPU vertex work
+void transformPositionsSoA(float *outX, float *outY, float *outZ, const Mat4x4 *mat, const float *x, const float *y, const float *z, int count);
+void projectPositionsSoA(float *outX, float *outY, float *outZ, float *outW, const Mat4x4 *mat, const float *x, const float *y, const float *z, int count);
+
 void createPerspectiveProjection(Mat4x4 *mat, float fov, float aspect, float zNear, float zFar);
 void createRotationMatrix(Mat4x4* model, float angleX, float angleY, float angleZ);
 void lookAt(Mat4x4* view, Vertex eye, Vertex target, Vertex up);
+void screenRay(const Mat4x4 *model, const Mat4x4 *view, const Mat4x4 *projection, float x, float y, int width, int height, float *origin, float *dir);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
\ No newline at end of file
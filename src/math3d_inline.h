@@ -0,0 +1,45 @@
+#ifndef MATH3D_INLINE_H
+#define MATH3D_INLINE_H
+
+// Small math helpers defined in the header so every translation unit can inline
+// them, and calls with constant arguments fold at compile time. Included from
+// math3d.h after the types, only plain aggregate initializers so C++ can use it too.
+// The SIMD matrix kernels stay in math3d.c: they run once per mesh, or once per
+// batch of vertices, and inlining them saves under a nanosecond a call.
+
+static inline Vertex normalize(Vertex v) {
+    float magnitude = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    Vertex normalized = { v.x / magnitude, v.y / magnitude, v.z / magnitude };
+    return normalized;
+}
+
+static inline Vertex subtractVec3d(Vertex v1, Vertex v2) {
+    Vertex result = {v1.x - v2.x, v1.y - v2.y, v1.z - v2.z};
+    return result;
+}
+
+static inline float dotProduct(Vertex v1, Vertex v2) {
+    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+}
+
+static inline Vertex crossProduct(Vertex v1, Vertex v2) {
+    Vertex cross = {
+        v1.y * v2.z - v1.z * v2.y,
+        v1.z * v2.x - v1.x * v2.z,
+        v1.x * v2.y - v1.y * v2.x
+    };
+    return cross;
+}
+
+static inline Mat4x4 perspectiveMatrix(float fov, float aspect, float zNear, float zFar) {
+    float tanHalfFov = tanf(fov / 2.0f);
+    Mat4x4 mat = {{
+        {1.0f / (aspect * tanHalfFov), 0.0f, 0.0f, 0.0f},
+        {0.0f, 1.0f / tanHalfFov, 0.0f, 0.0f},
+        {0.0f, 0.0f, -(zFar + zNear) / (zFar - zNear), -1.0f},
+        {0.0f, 0.0f, -(2.0f * zFar * zNear) / (zFar - zNear), 0.0f}
+    }};
+    return mat;
+}
+
+#endif
@@ -3,126 +3,234 @@
 #include <string.h>
 #include <GL/glew.h>
 #include "mesh.h"
+#include "glstats.h"
+#include "trace.h"
 
-Mesh parseOBJ(char* file, float *pos, char *color, float scale) {
+#define OBJ_MAX_FACE 64     // Corners of the largest polygon a face line may have
+
+Mesh parseOBJ(GeometryArena *arena, char* file, float *pos, char *color, float scale) {
+    Mesh newMesh = loadOBJ(file, pos, color, scale);
+    if (newMesh.vertexCount > 0 && !uploadMesh(arena, &newMesh))
+        printf("Could not place %s in the geometry arena\n", file);
+    return newMesh;
+}
+
+// Grows data to hold at least needed elements of size bytes
+static void *growArray(void *data, int *capacity, int needed, size_t size) {
+    if (needed <= *capacity)
+        return data;
+    int grown = *capacity ? *capacity : 1024;
+    while (grown < needed) grown *= 2;
+    *capacity = grown;
+    return realloc(data, grown * size);
+}
+
+// Reads the file and builds everything on the CPU side, no GL calls, so it can
+// run on any thread. uploadMesh() has to follow on the GL thread. A file that
+// cannot be parsed gives a mesh with no vertices.
+Mesh loadOBJ(char* file, float *pos, char *color, float scale) {
     Mesh newMesh;
     newMesh.vertices = NULL;
     newMesh.indices = NULL;
     newMesh.vertexCount = 0;
     newMesh.indiceCount = 0;
-    newMesh.scale = scale;
-    newMesh.pos[0] = pos[0];
-    newMesh.pos[1] = pos[1];
-    newMesh.pos[2] = pos[2];
+    newMesh.arena = NULL;
+    newMesh.baseVertex = newMesh.firstIndex = 0;
+    newMesh.localBounds = (Bounds){0};
+    newMesh.bvh = NULL;
+    setMeshTransform(&newMesh, createTransform(pos, scale));
+    updateMeshTransform(&newMesh);
     
     setColor(&newMesh, color);
 
+    TraceZone zone = beginZone("loadOBJ");
     FILE* fp = fopen(file, "r");
     if (!fp) {
         printf("Could not open file %s\n", file);
+        endZone(zone);
         return newMesh;
     }
 
-    float vertices[3][100*100] = {0};
-    float normals[3][100*100] = {0};
-    int vertexCount = 0;
-    int normalCount = 0;
-
-    int vertexIndexArr[100*100] = {0};
-    int normalIndexArr[100*100] = {0};
-    int indiceCount = 0;
-    int facesCount = 0;
-    int skip = 0;
+    float *positions = NULL, *normals = NULL;         // Three floats each
+    int vertexCount = 0, vertexCapacity = 0;
+    int normalCount = 0, normalCapacity = 0;
+    int *corners = NULL;                                // Position and normal index of each triangle corner, 1-based
+    int indiceCount = 0, cornerCapacity = 0;
+    int malformed = 0;
 
+    TraceZone readZone = beginZone("read OBJ");
     char line[1024];
-    while (fgets(line, sizeof(line), fp)) {
+    int lineNumber = 0;
+    while (!malformed && fgets(line, sizeof(line), fp)) {
+        lineNumber++;
         if (line[0] == '#' || line[0] == '\n') continue;
         if (line[0] == 'v' && line[1] == ' ') {
             float x, y, z;
-            if (sscanf(line, "v %f %f %f", &x, &y, &z) == 3) {
-                vertices[0][vertexCount] = (x * newMesh.scale) + newMesh.pos[0];
-                vertices[1][vertexCount] = (y * newMesh.scale) + newMesh.pos[1];
-                vertices[2][vertexCount] = (z * newMesh.scale) + newMesh.pos[2];
-                vertexCount++;
+            if (sscanf(line, "v %f %f %f", &x, &y, &z) != 3) {
+                malformed = 1;
+                break;
             }
+            positions = growArray(positions, &vertexCapacity, vertexCount + 1, 3 * sizeof(float));
+            positions[vertexCount * 3] = x;
+            positions[vertexCount * 3 + 1] = y;
+            positions[vertexCount * 3 + 2] = z;
+            vertexCount++;
         }
         if (line[0] == 'v' && line[1] == 'n') {
             float nx, ny, nz;
-            if (sscanf(line, "vn %f %f %f", &nx, &ny, &nz) == 3) {
-                normals[0][normalCount] = nx;
-                normals[1][normalCount] = ny;
-                normals[2][normalCount] = nz;
-                normalCount++;
+            if (sscanf(line, "vn %f %f %f", &nx, &ny, &nz) != 3) {
+                malformed = 1;
+                break;
             }
+            normals = growArray(normals, &normalCapacity, normalCount + 1, 3 * sizeof(float));
+            normals[normalCount * 3] = nx;
+            normals[normalCount * 3 + 1] = ny;
+            normals[normalCount * 3 + 2] = nz;
+            normalCount++;
         }
         if (line[0] == 'f' && line[1] == ' ') {
-            sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-            &vertexIndexArr[indiceCount], &skip, &normalIndexArr[indiceCount],
-            &vertexIndexArr[indiceCount+1], &skip, &normalIndexArr[indiceCount+1],
-            &vertexIndexArr[indiceCount+2], &skip, &normalIndexArr[indiceCount+2]);
-            
-            indiceCount += 3;
-            facesCount++;
+            // v, v/vt, v//vn or v/vt/vn per corner, polygons are split into a fan
+            int face[OBJ_MAX_FACE][2];
+            int n = 0;
+            for (char *token = strtok(line + 2, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+                int v, vt, vn = 0;
+                if (n == OBJ_MAX_FACE ||
+                    (sscanf(token, "%d/%d/%d", &v, &vt, &vn) != 3 && sscanf(token, "%d//%d", &v, &vn) != 2 &&
+                     sscanf(token, "%d/%d", &v, &vt) != 2 && sscanf(token, "%d", &v) != 1)) {
+                    malformed = 1;
+                    break;
+                }
+                // Negative indices count back from the latest vertex
+                face[n][0] = v < 0 ? vertexCount + v + 1 : v;
+                face[n][1] = vn < 0 ? normalCount + vn + 1 : vn;
+                if (face[n][0] < 1 || face[n][0] > vertexCount || face[n][1] < 0 || face[n][1] > normalCount) {
+                    malformed = 1;
+                    break;
+                }
+                n++;
+            }
+            if (malformed || n < 3) {
+                malformed = 1;
+                break;
+            }
+            corners = growArray(corners, &cornerCapacity, indiceCount + (n - 2) * 3, 2 * sizeof(int));
+            for (int k = 1; k + 1 < n; k++) {
+                memcpy(corners + indiceCount * 2, face[0], sizeof(face[0]));
+                memcpy(corners + indiceCount * 2 + 2, face[k], sizeof(face[0]));
+                memcpy(corners + indiceCount * 2 + 4, face[k + 1], sizeof(face[0]));
+                indiceCount += 3;
+            }
         }
     }
     fclose(fp);
+    endZone(readZone);
+
+    if (malformed || indiceCount == 0) {
+        if (malformed)
+            printf("Malformed OBJ %s at line %d\n", file, lineNumber);
+        else
+            printf("No faces in %s\n", file);
+        free(positions);
+        free(normals);
+        free(corners);
+        endZone(zone);
+        return newMesh;
+    }
 
+    TraceZone vertexZone = beginZone("build vertices");
     newMesh.vertexCount = newMesh.indiceCount = indiceCount;
     newMesh.vertices = malloc(newMesh.vertexCount * sizeof(Vertex));
     newMesh.indices = malloc(newMesh.indiceCount * sizeof(unsigned int));
 
-    for(int i = 0; i < indiceCount; i++) {
-        newMesh.vertices[i].x = vertices[0][vertexIndexArr[i] -1];
-        newMesh.vertices[i].y = vertices[1][vertexIndexArr[i] -1];
-        newMesh.vertices[i].z = vertices[2][vertexIndexArr[i] -1];
-        newMesh.vertices[i].nx = normals[0][normalIndexArr[i] -1];
-        newMesh.vertices[i].ny = normals[1][normalIndexArr[i] -1];
-        newMesh.vertices[i].nz = normals[2][normalIndexArr[i] -1];
+    for (int i = 0; i < indiceCount; i++) {
+        const float *p = positions + (corners[i * 2] - 1) * 3;
+        newMesh.vertices[i].x = p[0];
+        newMesh.vertices[i].y = p[1];
+        newMesh.vertices[i].z = p[2];
         newMesh.vertices[i].r = newMesh.color[0];
         newMesh.vertices[i].g = newMesh.color[1];
         newMesh.vertices[i].b = newMesh.color[2];
-
         newMesh.indices[i] = i;
     }
-    
-    glGenVertexArrays(1, &newMesh.VAO);
-    glGenBuffers(1, &newMesh.VBO);
-    glGenBuffers(1, &newMesh.EBO);
+    for (int i = 0; i < indiceCount; i += 3) {
+        // Corners without a normal get the face normal
+        Vertex *tri = &newMesh.vertices[i];
+        Vertex faceNormal = crossProduct(subtractVec3d(tri[1], tri[0]), subtractVec3d(tri[2], tri[0]));
+        float length = sqrtf(dotProduct(faceNormal, faceNormal));
+        for (int k = 0; k < 3; k++) {
+            int normal = corners[(i + k) * 2 + 1];
+            if (normal > 0) {
+                tri[k].nx = normals[(normal - 1) * 3];
+                tri[k].ny = normals[(normal - 1) * 3 + 1];
+                tri[k].nz = normals[(normal - 1) * 3 + 2];
+            }
+            else {
+                tri[k].nx = length > 0.0f ? faceNormal.x / length : 0.0f;
+                tri[k].ny = length > 0.0f ? faceNormal.y / length : 0.0f;
+                tri[k].nz = length > 0.0f ? faceNormal.z / length : 1.0f;
+            }
+        }
+    }
+    free(positions);
+    free(normals);
+    free(corners);
+    endZone(vertexZone);
 
-    glBindVertexArray(newMesh.VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, newMesh.VBO);
-    glBufferData(GL_ARRAY_BUFFER, newMesh.vertexCount * sizeof(Vertex), newMesh.vertices, GL_STATIC_DRAW);
+    TraceZone boundsZone = beginZone("bounds");
+    newMesh.localBounds = computeBounds(&newMesh.vertices[0].x, newMesh.vertexCount, sizeof(Vertex) / sizeof(float));
+    newMesh.transformDirty = 1;
+    updateMeshTransform(&newMesh);
+    endZone(boundsZone);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, newMesh.EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, newMesh.indiceCount * sizeof(unsigned int), newMesh.indices, GL_STATIC_DRAW);
+    TraceZone bvhZone = beginZone("BVH");
+    newMesh.bvh = buildBVH(&newMesh.vertices[0].x, sizeof(Vertex) / sizeof(float), newMesh.indices, newMesh.indiceCount);
+    endZone(bvhZone);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(0);
+    endZone(zone);
+    return newMesh;
+}
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+int uploadMesh(GeometryArena *arena, Mesh *mesh) {
+    TraceZone zone = beginZone("upload");
+    int placed = allocateGeometry(arena, mesh->vertices, mesh->vertexCount, mesh->indices, mesh->indiceCount,
+                                  &mesh->baseVertex, &mesh->firstIndex);
+    if (placed)
+        mesh->arena = arena;
+    endZone(zone);
+    return placed;
+}
 
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+void setMeshTransform(Mesh *mesh, Transform transform) {
+    mesh->transform = transform;
+    mesh->transformDirty = 1;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0); 
-    glBindVertexArray(0);
+// Rebuilds the model matrix and scene bounds after the transform changed.
+// Returns 1 when it did, so callers can refresh anything derived from bounds.
+int updateMeshTransform(Mesh *mesh) {
+    if (!mesh->transformDirty)
+        return 0;
 
-    return newMesh;
+    transformToMatrix(&mesh->model, &mesh->transform);
+    normalMatrix(&mesh->normalMatrix, &mesh->model);
+    mesh->bounds = transformBounds(mesh->localBounds, &mesh->model);
+    mesh->transformDirty = 0;
+    return 1;
 }
 
+// Expects the arena's VAO to be bound
 void renderMesh(Mesh mesh, int mode) {
-    glBindVertexArray(mesh.VAO);
-    glDrawElements(mode, mesh.indiceCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    glDrawElementsBaseVertex(mode, mesh.indiceCount, GL_UNSIGNED_INT,
+                             (void*)((size_t)mesh.firstIndex * sizeof(unsigned int)), mesh.baseVertex);
+    glStats.drawCalls++;
 }
 
 void destroyMesh(Mesh *mesh) {
-    glDeleteVertexArrays(1, &mesh->VAO);
-    glDeleteBuffers(1, &mesh->VBO);
-    glDeleteBuffers(1, &mesh->EBO);
+    if (mesh->arena)
+        freeGeometry(mesh->arena, mesh->baseVertex, mesh->vertexCount, mesh->firstIndex, mesh->indiceCount);
     free(mesh->indices);
     free(mesh->vertices);
+    destroyBVH(mesh->bvh);
 }
 
 void setColor(Mesh *mesh, char *color) {
@@ -1,6 +1,11 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include "bounds.h"
+#include "bvh.h"
+#include "transform.h"
+#include "arena.h"
+
 #define POS(x,y,z) (float[]){x,y,z}
 
 #define OBJ_IXO_SPHERE "models/ixo.obj"
@@ -8,25 +13,30 @@
 #define OBJ_TORUS "models/torus.obj"
 #define OBJ_CUBE "models/cube.obj"
 
-typedef struct vertex {
-    float x, y, z;
-    float r, g, b;
-    float nx, ny, nz;
-} Vertex;
 
 typedef struct mesh {
     Vertex *vertices;
     unsigned int *indices;
     int vertexCount, indiceCount;
-    unsigned int VAO, VBO, EBO;
+    GeometryArena *arena;           // NULL until uploadMesh()
+    int baseVertex, firstIndex;     // Where the geometry lives in the arena
 
-    float pos[3];
     float color[3];
-    float scale;
+    Transform transform;        // Placement in the scene, vertices stay in object space
+    Mat4x4 model;
+    Mat3x3 normalMatrix;
+    int transformDirty;         // model, normalMatrix and bounds need rebuilding
+    Bounds localBounds;         // Object space
+    Bounds bounds;              // Scene space, follows transform
+    BVH *bvh;                   // Object space
 } Mesh;
 
-Mesh parseOBJ(char* file, float *pos, char *color, float scale);
+Mesh parseOBJ(GeometryArena *arena, char* file, float *pos, char *color, float scale);
+Mesh loadOBJ(char* file, float *pos, char *color, float scale);
+int uploadMesh(GeometryArena *arena, Mesh *mesh);
 void setColor(Mesh *mesh, char *color);
+void setMeshTransform(Mesh *mesh, Transform transform);
+int updateMeshTransform(Mesh *mesh);
 void renderMesh(Mesh mesh, int mode);
 void destroyMesh(Mesh *mesh);
 
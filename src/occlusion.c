@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <float.h>
+#include "occlusion.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+// Anything closer than this in clip space is treated as crossing the near plane
+#define NEAR_W 0.1f
+
+static inline float min3(float a, float b, float c) { return a < b ? (a < c ? a : c) : (b < c ? b : c); }
+static inline float max3(float a, float b, float c) { return a > b ? (a > c ? a : c) : (b > c ? b : c); }
+
+// Clip space position of p, columns of the matrix are contiguous
+static inline void projectPoint(const Mat4x4 *m, float x, float y, float z, float out[4]) {
+#ifdef OCCLUSION_SSE
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m->m[0]), _mm_set1_ps(x)),
+                                     _mm_mul_ps(_mm_loadu_ps(m->m[1]), _mm_set1_ps(y))),
+                          _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m->m[2]), _mm_set1_ps(z)),
+                                     _mm_loadu_ps(m->m[3])));
+    _mm_storeu_ps(out, r);
+#else
+    for (int i = 0; i < 4; i++) {
+        out[i] = m->m[0][i] * x + m->m[1][i] * y + m->m[2][i] * z + m->m[3][i];
+    }
+#endif
+}
+
+static void rasterizeTile(OcclusionBuffer *ob, int tileX, int tileY) {
+    int x0 = tileX * OCCLUSION_TILE_W, y0 = tileY * OCCLUSION_TILE_H;
+    int x1 = x0 + OCCLUSION_TILE_W - 1, y1 = y0 + OCCLUSION_TILE_H - 1;
+    if (x1 >= ob->width) x1 = ob->width - 1;
+    if (y1 >= ob->height) y1 = ob->height - 1;
+    float *depth = ob->levels[0];
+
+    for (int t = 0; t < ob->triangleCount; t++) {
+        const float *v = ob->triangles + t * 9;
+        float ax = v[0], ay = v[1], az = v[2];
+        float bx = v[3], by = v[4], bz = v[5];
+        float cx = v[6], cy = v[7], cz = v[8];
+
+        int minX = (int)min3(ax, bx, cx), maxX = (int)max3(ax, bx, cx);
+        int minY = (int)min3(ay, by, cy), maxY = (int)max3(ay, by, cy);
+        if (minX < x0) minX = x0;
+        if (minY < y0) minY = y0;
+        if (maxX > x1) maxX = x1;
+        if (maxY > y1) maxY = y1;
+        if (minX > maxX || minY > maxY) continue;
+
+        float area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+        if (area == 0.0f) continue;
+        if (area < 0.0f) {
+            float tx = bx, ty = by, tz = bz;
+            bx = cx; by = cy; bz = cz;
+            cx = tx; cy = ty; cz = tz;
+            area = -area;
+        }
+
+        // Edge functions E = A*x + B*y + C, positive on the inside
+        float A0 = by - cy, B0 = cx - bx, C0 = bx * cy - by * cx;   // b -> c
+        float A1 = cy - ay, B1 = ax - cx, C1 = cx * ay - cy * ax;   // c -> a
+        float A2 = ay - by, B2 = bx - ax, C2 = ax * by - ay * bx;   // a -> b
+
+        // Depth as a plane over the screen
+        float inv = 1.0f / area;
+        float dzdx = (az * A0 + bz * A1 + cz * A2) * inv;
+        float dzdy = (az * B0 + bz * B1 + cz * B2) * inv;
+        float z0 = (az * C0 + bz * C1 + cz * C2) * inv;
+
+#ifdef OCCLUSION_SSE
+        // Tiles start on multiples of four so a batch never crosses into a neighbour
+        int startX = minX & ~3;
+        __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 zero = _mm_setzero_ps();
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            __m128 rowE0 = _mm_set1_ps(B0 * py + C0);
+            __m128 rowE1 = _mm_set1_ps(B1 * py + C1);
+            __m128 rowE2 = _mm_set1_ps(B2 * py + C2);
+            __m128 rowZ = _mm_set1_ps(dzdy * py + z0);
+            float *row = depth + y * ob->width;
+            for (int x = startX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A0), px), rowE0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A1), px), rowE1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A2), px), rowE2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (!_mm_movemask_ps(inside)) continue;
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), rowZ);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 closer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float *row = depth + y * ob->width;
+            for (int x = minX; x <= maxX; x++) {
+                float px = x + 0.5f;
+                if (A0 * px + B0 * py + C0 < 0.0f || A1 * px + B1 * py + C1 < 0.0f || A2 * px + B2 * py + C2 < 0.0f)
+                    continue;
+                float z = z0 + dzdx * px + dzdy * py;
+                if (z < row[x]) row[x] = z;
+            }
+        }
+#endif
+    }
+}
+
+static void rasterizeTiles(OcclusionBuffer *ob) {
+    int tilesX = (ob->width + OCCLUSION_TILE_W - 1) / OCCLUSION_TILE_W;
+    int tilesY = (ob->height + OCCLUSION_TILE_H - 1) / OCCLUSION_TILE_H;
+    int tile;
+    while ((tile = SDL_AtomicAdd(&ob->nextTile, 1)) < tilesX * tilesY) {
+        rasterizeTile(ob, tile % tilesX, tile / tilesX);
+    }
+}
+
+static int occlusionWorker(void *data) {
+    OcclusionBuffer *ob = data;
+    for (;;) {
+        SDL_SemWait(ob->start);
+        if (ob->quit) break;
+        rasterizeTiles(ob);
+        SDL_SemPost(ob->done);
+    }
+    return 0;
+}
+
+OcclusionBuffer *createOcclusionBuffer(int width, int height, int workerCount) {
+    OcclusionBuffer *ob = calloc(1, sizeof(OcclusionBuffer));
+    // Rows are processed four pixels at a time
+    ob->width = (width + 3) & ~3;
+    ob->height = height;
+
+    int w = ob->width, h = ob->height;
+    while (ob->levelCount < OCCLUSION_LEVELS) {
+        ob->levelWidth[ob->levelCount] = w;
+        ob->levelHeight[ob->levelCount] = h;
+        ob->levels[ob->levelCount] = malloc(w * h * sizeof(float));
+        ob->levelCount++;
+        if (w == 1 && h == 1) break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    ob->start = SDL_CreateSemaphore(0);
+    ob->done = SDL_CreateSemaphore(0);
+    ob->workerCount = workerCount > 0 ? workerCount : 0;
+    ob->workers = calloc(ob->workerCount + 1, sizeof(SDL_Thread *));
+    for (int i = 0; i < ob->workerCount; i++) {
+        ob->workers[i] = SDL_CreateThread(occlusionWorker, "occlusion", ob);
+    }
+    return ob;
+}
+
+void clearOcclusionBuffer(OcclusionBuffer *ob, const Mat4x4 *clip) {
+    float *depth = ob->levels[0];
+    for (int i = 0; i < ob->width * ob->height; i++) {
+        depth[i] = 1.0f;
+    }
+    ob->clip = *clip;
+    ob->triangleCount = 0;
+}
+
+void addOccluder(OcclusionBuffer *ob, const Mesh *mesh) {
+    int needed = ob->triangleCount + mesh->indiceCount / 3;
+    if (needed > ob->triangleCapacity) {
+        ob->triangleCapacity = needed * 2;
+        ob->triangles = realloc(ob->triangles, ob->triangleCapacity * 9 * sizeof(float));
+    }
+
+    // Vertices are in object space
+    Mat4x4 meshClip;
+    multiplyMatricesPtr(&meshClip, &mesh->model, &ob->clip);
+
+    for (int i = 0; i + 2 < mesh->indiceCount; i += 3) {
+        float *out = ob->triangles + ob->triangleCount * 9;
+        int skip = 0;
+        for (int k = 0; k < 3; k++) {
+            const Vertex *v = &mesh->vertices[mesh->indices[i + k]];
+            float clip[4];
+            projectPoint(&meshClip, v->x, v->y, v->z, clip);
+            // Triangles crossing the near plane are left out, which only loses occlusion
+            if (clip[3] < NEAR_W) {
+                skip = 1;
+                break;
+            }
+            float invW = 1.0f / clip[3];
+            out[k * 3 + 0] = (clip[0] * invW * 0.5f + 0.5f) * ob->width;
+            out[k * 3 + 1] = (0.5f - clip[1] * invW * 0.5f) * ob->height;
+            out[k * 3 + 2] = clip[2] * invW;
+        }
+        if (!skip) ob->triangleCount++;
+    }
+}
+
+static void buildDepthPyramid(OcclusionBuffer *ob) {
+    for (int l = 1; l < ob->levelCount; l++) {
+        const float *src = ob->levels[l - 1];
+        float *dst = ob->levels[l];
+        int srcW = ob->levelWidth[l - 1], srcH = ob->levelHeight[l - 1];
+        for (int y = 0; y < ob->levelHeight[l]; y++) {
+            int sy0 = y * 2, sy1 = y * 2 + 1 < srcH ? y * 2 + 1 : y * 2;
+            for (int x = 0; x < ob->levelWidth[l]; x++) {
+                int sx0 = x * 2, sx1 = x * 2 + 1 < srcW ? x * 2 + 1 : x * 2;
+                float a = src[sy0 * srcW + sx0], b = src[sy0 * srcW + sx1];
+                float c = src[sy1 * srcW + sx0], d = src[sy1 * srcW + sx1];
+                float m = a > b ? a : b;
+                if (c > m) m = c;
+                if (d > m) m = d;
+                dst[y * ob->levelWidth[l] + x] = m;
+            }
+        }
+    }
+}
+
+void rasterizeOccluders(OcclusionBuffer *ob) {
+    SDL_AtomicSet(&ob->nextTile, 0);
+    for (int i = 0; i < ob->workerCount; i++) {
+        SDL_SemPost(ob->start);
+    }
+    rasterizeTiles(ob);
+    for (int i = 0; i < ob->workerCount; i++) {
+        SDL_SemWait(ob->done);
+    }
+    buildDepthPyramid(ob);
+}
+
+// Returns 1 when some part of the box may be in front of the occluders
+int testOcclusion(const OcclusionBuffer *ob, Bounds bounds) {
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        float clip[4];
+        projectPoint(&ob->clip,
+                     (i & 1) ? bounds.max[0] : bounds.min[0],
+                     (i & 2) ? bounds.max[1] : bounds.min[1],
+                     (i & 4) ? bounds.max[2] : bounds.min[2], clip);
+        if (clip[3] < NEAR_W)
+            return 1;
+        float invW = 1.0f / clip[3];
+        float x = (clip[0] * invW * 0.5f + 0.5f) * ob->width;
+        float y = (0.5f - clip[1] * invW * 0.5f) * ob->height;
+        float z = clip[2] * invW;
+        if (x < minX) minX = x;
+        if (x > maxX) maxX = x;
+        if (y < minY) minY = y;
+        if (y > maxY) maxY = y;
+        if (z < minZ) minZ = z;
+    }
+
+    if (maxX < 0.0f || maxY < 0.0f || minX >= ob->width || minY >= ob->height)
+        return 1;
+
+    int x0 = minX < 0.0f ? 0 : (int)minX;
+    int y0 = minY < 0.0f ? 0 : (int)minY;
+    int x1 = maxX >= ob->width ? ob->width - 1 : (int)maxX;
+    int y1 = maxY >= ob->height ? ob->height - 1 : (int)maxY;
+
+    // Go up the pyramid until the box covers at most 2x2 texels
+    int level = 0;
+    while (level < ob->levelCount - 1 && (x1 - x0 > 1 || y1 - y0 > 1)) {
+        x0 >>= 1; y0 >>= 1;
+        x1 >>= 1; y1 >>= 1;
+        level++;
+    }
+
+    const float *depth = ob->levels[level];
+    int w = ob->levelWidth[level];
+    float maxDepth = -FLT_MAX;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (depth[y * w + x] > maxDepth) maxDepth = depth[y * w + x];
+        }
+    }
+    return minZ <= maxDepth;
+}
+
+// Picks the visible meshes that cover the most of the screen
+int selectOccluders(const OcclusionBuffer *ob, const Mesh *meshes, const unsigned char *visible, int meshCount, int *occluders, int maxOccluders) {
+    float scores[MAX_OCCLUDERS];
+    int count = 0;
+    if (maxOccluders > MAX_OCCLUDERS) maxOccluders = MAX_OCCLUDERS;
+
+    for (int i = 0; i < meshCount; i++) {
+        if (!visible[i] || meshes[i].bounds.radius <= 0.0f) continue;
+        float clip[4];
+        projectPoint(&ob->clip, meshes[i].bounds.center[0], meshes[i].bounds.center[1], meshes[i].bounds.center[2], clip);
+        if (clip[3] < NEAR_W) continue;
+        float score = meshes[i].bounds.radius / clip[3];
+
+        int slot = count < maxOccluders ? count++ : maxOccluders;
+        while (slot > 0 && scores[slot - 1] < score) {
+            if (slot < maxOccluders) {
+                scores[slot] = scores[slot - 1];
+                occluders[slot] = occluders[slot - 1];
+            }
+            slot--;
+        }
+        if (slot < maxOccluders) {
+            scores[slot] = score;
+            occluders[slot] = i;
+        }
+    }
+    return count;
+}
+
+// Rasterizes the largest visible meshes and hides every visible mesh behind them.
+// Returns how many meshes were hidden.
+int cullOccluded(OcclusionBuffer *ob, const Mesh *meshes, unsigned char *visible, int meshCount) {
+    int occluders[MAX_OCCLUDERS];
+    int occluderCount = selectOccluders(ob, meshes, visible, meshCount, occluders, MAX_OCCLUDERS);
+    for (int i = 0; i < occluderCount; i++) {
+        addOccluder(ob, &meshes[occluders[i]]);
+    }
+    rasterizeOccluders(ob);
+
+    int occluded = 0;
+    for (int i = 0; i < meshCount; i++) {
+        if (visible[i] && !testOcclusion(ob, meshes[i].bounds)) {
+            visible[i] = 0;
+            occluded++;
+        }
+    }
+    return occluded;
+}
+
+void destroyOcclusionBuffer(OcclusionBuffer *ob) {
+    ob->quit = 1;
+    for (int i = 0; i < ob->workerCount; i++) {
+        SDL_SemPost(ob->start);
+    }
+    for (int i = 0; i < ob->workerCount; i++) {
+        SDL_WaitThread(ob->workers[i], NULL);
+    }
+    SDL_DestroySemaphore(ob->start);
+    SDL_DestroySemaphore(ob->done);
+    for (int l = 0; l < ob->levelCount; l++) {
+        free(ob->levels[l]);
+    }
+    free(ob->triangles);
+    free(ob->workers);
+    free(ob);
+}
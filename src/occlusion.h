@@ -0,0 +1,43 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <SDL2/SDL.h>
+#include "math3d.h"
+#include "mesh.h"
+#include "bounds.h"
+
+#define OCCLUSION_WIDTH     256
+#define OCCLUSION_HEIGHT    144
+#define OCCLUSION_TILE_W    64
+#define OCCLUSION_TILE_H    16
+#define OCCLUSION_LEVELS    8
+#define MAX_OCCLUDERS       8
+
+// Low resolution CPU depth buffer with a max-depth pyramid on top of it
+typedef struct occlusionBuffer {
+    int width, height;
+    int levelCount;
+    int levelWidth[OCCLUSION_LEVELS], levelHeight[OCCLUSION_LEVELS];
+    float *levels[OCCLUSION_LEVELS];    // levels[0] is the full resolution depth
+
+    Mat4x4 clip;
+    float *triangles;                   // x, y, depth for each corner in screen space
+    int triangleCount, triangleCapacity;
+
+    SDL_Thread **workers;
+    int workerCount;
+    SDL_sem *start, *done;
+    SDL_atomic_t nextTile;
+    int quit;
+} OcclusionBuffer;
+
+OcclusionBuffer *createOcclusionBuffer(int width, int height, int workerCount);
+void clearOcclusionBuffer(OcclusionBuffer *ob, const Mat4x4 *clip);
+void addOccluder(OcclusionBuffer *ob, const Mesh *mesh);
+void rasterizeOccluders(OcclusionBuffer *ob);
+int testOcclusion(const OcclusionBuffer *ob, Bounds bounds);
+int selectOccluders(const OcclusionBuffer *ob, const Mesh *meshes, const unsigned char *visible, int meshCount, int *occluders, int maxOccluders);
+int cullOccluded(OcclusionBuffer *ob, const Mesh *meshes, unsigned char *visible, int meshCount);
+void destroyOcclusionBuffer(OcclusionBuffer *ob);
+
+#endif
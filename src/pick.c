@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "pick.h"
+
+typedef struct meshEntry {
+    int mesh;
+    float tNear;
+} MeshEntry;
+
+// Distance to where the ray enters the box, or -1 on a miss
+static float intersectBox(const Bounds *b, const float *origin, const float *invDir) {
+    float tNear = 0.0f, tFar = FLT_MAX;
+    for (int k = 0; k < 3; k++) {
+        float t0 = (b->min[k] - origin[k]) * invDir[k];
+        float t1 = (b->max[k] - origin[k]) * invDir[k];
+        if (t0 > t1) {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        if (t0 > tNear) tNear = t0;
+        if (t1 < tFar) tFar = t1;
+    }
+    return tNear <= tFar ? tNear : -1.0f;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    float da = ((const MeshEntry *)a)->tNear, db = ((const MeshEntry *)b)->tNear;
+    return (da > db) - (da < db);
+}
+
+// Closest triangle hit along the ray. The mesh boxes act as the top level: meshes are
+// visited nearest box first and the search stops once a box starts past the best hit.
+int pickMesh(const Mesh *meshes, int meshCount, const float *origin, const float *dir, PickResult *result) {
+    float invDir[3];
+    for (int k = 0; k < 3; k++) {
+        invDir[k] = fabsf(dir[k]) > 1e-20f ? 1.0f / dir[k] : copysignf(1e30f, dir[k]);
+    }
+
+    MeshEntry *entries = malloc(meshCount * sizeof(MeshEntry));
+    int entryCount = 0;
+    for (int i = 0; i < meshCount; i++) {
+        if (!meshes[i].bvh) continue;
+        float tNear = intersectBox(&meshes[i].bounds, origin, invDir);
+        if (tNear >= 0.0f) {
+            entries[entryCount].mesh = i;
+            entries[entryCount].tNear = tNear;
+            entryCount++;
+        }
+    }
+    qsort(entries, entryCount, sizeof(MeshEntry), compareEntries);
+
+    float best = FLT_MAX;
+    int found = 0;
+    for (int i = 0; i < entryCount && entries[i].tNear < best; i++) {
+        const Mesh *mesh = &meshes[entries[i].mesh];
+        // The BVH is in object space. The direction is not renormalized, so t
+        // along the local ray is the same t along the scene ray.
+        Mat4x4 inv;
+        if (!invertAffineMatrix(&inv, &mesh->model)) continue;
+        float localOrigin[3], localDir[3];
+        for (int k = 0; k < 3; k++) {
+            localOrigin[k] = inv.m[0][k] * origin[0] + inv.m[1][k] * origin[1] + inv.m[2][k] * origin[2] + inv.m[3][k];
+            localDir[k] = inv.m[0][k] * dir[0] + inv.m[1][k] * dir[1] + inv.m[2][k] * dir[2];
+        }
+
+        BVHHit hit;
+        if (intersectBVH(mesh->bvh, localOrigin, localDir, best, &hit)) {
+            best = hit.t;
+            result->mesh = entries[i].mesh;
+            result->triangle = hit.triangle;
+            result->t = hit.t;
+            found = 1;
+        }
+    }
+    free(entries);
+
+    if (found) {
+        for (int k = 0; k < 3; k++) {
+            result->position[k] = origin[k] + dir[k] * result->t;
+        }
+    }
+    return found;
+}
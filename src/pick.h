@@ -0,0 +1,14 @@
+#ifndef PICK_H
+#define PICK_H
+
+#include "mesh.h"
+
+typedef struct pickResult {
+    int mesh, triangle;
+    float t;
+    float position[3];
+} PickResult;
+
+int pickMesh(const Mesh *meshes, int meshCount, const float *origin, const float *dir, PickResult *result);
+
+#endif
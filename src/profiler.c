@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+
+Profiler *createProfiler(void) {
+    Profiler *prof = calloc(1, sizeof(Profiler));
+    prof->activeQuery = -1;
+    prof->gpu = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (prof->gpu) {
+        for (int i = 0; i < PROFILE_LATENCY; i++) {
+            glGenQueries(PROFILE_QUERIES, prof->frames[i].queries);
+        }
+    } else {
+        printf("Timer queries are not available, profiling on the CPU only\n");
+    }
+    return prof;
+}
+
+static void addSample(float *history, int *count, float ms) {
+    history[*count % PROFILE_HISTORY] = ms;
+    (*count)++;
+}
+
+// Reads the queries issued PROFILE_LATENCY frames ago, if the GPU is done with all of them
+static void collectFrame(Profiler *prof, ProfileFrame *frame) {
+    if (frame->count == 0) return;
+
+    for (int i = 0; i < frame->count; i++) {
+        GLint available = 0;
+        glGetQueryObjectiv(frame->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            prof->droppedFrames++;
+            frame->count = 0;
+            return;
+        }
+    }
+
+    float ms[PROFILE_SCOPES];
+    int used[PROFILE_SCOPES] = {0};
+    for (int i = 0; i < frame->count; i++) {
+        GLuint64 ns;
+        glGetQueryObjectui64v(frame->queries[i], GL_QUERY_RESULT, &ns);
+        int scope = frame->scopes[i];
+        if (!used[scope]) ms[scope] = 0.0f;
+        ms[scope] += ns / 1e6f;
+        used[scope] = 1;
+    }
+    for (int i = 0; i < prof->scopeCount; i++) {
+        if (used[i])
+            addSample(prof->scopes[i].gpu, &prof->scopes[i].gpuCount, ms[i]);
+    }
+    frame->count = 0;
+}
+
+void beginProfileFrame(Profiler *prof) {
+    if (!prof) return;
+    if (prof->gpu)
+        collectFrame(prof, &prof->frames[prof->frame % PROFILE_LATENCY]);
+    for (int i = 0; i < prof->scopeCount; i++) {
+        prof->scopes[i].cpuFrame = 0.0f;
+        prof->scopes[i].used = 0;
+    }
+}
+
+void endProfileFrame(Profiler *prof) {
+    if (!prof) return;
+    for (int i = 0; i < prof->scopeCount; i++) {
+        ProfileScope *scope = &prof->scopes[i];
+        if (scope->used)
+            addSample(scope->cpu, &scope->cpuCount, scope->cpuFrame);
+    }
+    prof->frame++;
+}
+
+static int findScope(Profiler *prof, const char *name) {
+    for (int i = 0; i < prof->scopeCount; i++) {
+        if (strcmp(prof->scopes[i].name, name) == 0) return i;
+    }
+    if (prof->scopeCount == PROFILE_SCOPES) return -1;
+
+    ProfileScope *scope = &prof->scopes[prof->scopeCount];
+    snprintf(scope->name, sizeof(scope->name), "%s", name);
+    scope->query = -1;
+    return prof->scopeCount++;
+}
+
+// Returns the scope to hand to endProfile, -1 when there is nothing to end
+int beginProfile(Profiler *prof, const char *name) {
+    if (!prof) return -1;
+    int index = findScope(prof, name);
+    if (index < 0) return -1;
+
+    ProfileScope *scope = &prof->scopes[index];
+    ProfileFrame *frame = &prof->frames[prof->frame % PROFILE_LATENCY];
+    if (prof->gpu && prof->activeQuery < 0 && frame->count < PROFILE_QUERIES) {
+        scope->query = frame->count++;
+        frame->scopes[scope->query] = index;
+        glBeginQuery(GL_TIME_ELAPSED, frame->queries[scope->query]);
+        prof->activeQuery = scope->query;
+    }
+    scope->used = 1;
+    scope->cpuStart = SDL_GetPerformanceCounter();
+    return index;
+}
+
+void endProfile(Profiler *prof, int index) {
+    if (!prof || index < 0) return;
+    ProfileScope *scope = &prof->scopes[index];
+    scope->cpuFrame += (SDL_GetPerformanceCounter() - scope->cpuStart) * 1000.0f / SDL_GetPerformanceFrequency();
+    if (scope->query >= 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+        prof->activeQuery = -1;
+        scope->query = -1;
+    }
+}
+
+static int compareFloats(const void *a, const void *b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Average, median, 95th and 99th percentile of the samples still in the ring
+static void printTimes(const char *label, const float *history, int count) {
+    int n = count < PROFILE_HISTORY ? count : PROFILE_HISTORY;
+    if (n == 0) {
+        printf("  %s %36s", label, "-");
+        return;
+    }
+    float sorted[PROFILE_HISTORY];
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) {
+        sorted[i] = history[i];
+        sum += history[i];
+    }
+    qsort(sorted, n, sizeof(float), compareFloats);
+    printf("  %s %7.3f %7.3f %7.3f %7.3f", label, sum / n, sorted[n / 2], sorted[n * 95 / 100], sorted[n * 99 / 100]);
+}
+
+void printProfile(const Profiler *prof) {
+    printf("Profile over the last %d frames, ms (avg p50 p95 p99), %d frames of GPU times dropped\n",
+           prof->frame < PROFILE_HISTORY ? prof->frame : PROFILE_HISTORY, prof->droppedFrames);
+    for (int i = 0; i < prof->scopeCount; i++) {
+        const ProfileScope *scope = &prof->scopes[i];
+        printf("  %-16s", scope->name);
+        printTimes("CPU", scope->cpu, scope->cpuCount);
+        printTimes("GPU", scope->gpu, scope->gpuCount);
+        printf("\n");
+    }
+}
+
+void destroyProfiler(Profiler *prof) {
+    if (prof->gpu) {
+        for (int i = 0; i < PROFILE_LATENCY; i++) {
+            glDeleteQueries(PROFILE_QUERIES, prof->frames[i].queries);
+        }
+    }
+    free(prof);
+}
@@ -0,0 +1,53 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#define PROFILE_SCOPES  64
+#define PROFILE_QUERIES 256     // Timer queries per frame, later scopes are timed on the CPU only
+#define PROFILE_LATENCY 4       // Frames a query gets before its result is read
+#define PROFILE_HISTORY 240     // Samples kept per scope for the averages and percentiles
+#define PROFILE_NAME    32
+#define PROFILE_MESHES  16      // Meshes the viewer times one by one, the rest share a scope
+
+typedef struct profileScope {
+    char name[PROFILE_NAME];
+    Uint64 cpuStart;
+    int query;                          // Query of the open interval, -1 when there is none
+    float cpuFrame;                     // Summed over every interval of the current frame
+    int used;                           // Opened this frame
+    float cpu[PROFILE_HISTORY], gpu[PROFILE_HISTORY];
+    int cpuCount, gpuCount;             // Samples written, the rings wrap at PROFILE_HISTORY
+} ProfileScope;
+
+// Queries issued in one frame, with the scope each one times
+typedef struct profileFrame {
+    unsigned int queries[PROFILE_QUERIES];
+    int scopes[PROFILE_QUERIES];
+    int count;
+} ProfileFrame;
+
+// Scoped CPU and GPU timers. GPU intervals are GL_TIME_ELAPSED queries from a
+// ring of PROFILE_LATENCY frames, so a result is only read once the GPU has had
+// a few frames to finish it and the render thread never waits on one. Time
+// elapsed queries cannot nest, scopes opened inside another are CPU only.
+typedef struct profiler {
+    ProfileScope scopes[PROFILE_SCOPES];
+    int scopeCount;
+    ProfileFrame frames[PROFILE_LATENCY];
+    int frame;
+    int activeQuery;                    // Only one time elapsed query may be open
+    int gpu;                            // Timer queries are available
+    int droppedFrames;                  // GPU results still not ready after PROFILE_LATENCY frames
+} Profiler;
+
+Profiler *createProfiler(void);
+void beginProfileFrame(Profiler *prof);
+void endProfileFrame(Profiler *prof);
+int beginProfile(Profiler *prof, const char *name);
+void endProfile(Profiler *prof, int scope);
+void printProfile(const Profiler *prof);
+void destroyProfiler(Profiler *prof);
+
+#endif
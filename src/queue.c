@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include "queue.h"
+
+// Opaque draws sort front to back so early-Z rejects hidden fragments, transparent
+// ones back to front so they blend correctly
+uint64_t renderKey(int pass, unsigned int program, unsigned int material, unsigned int VAO, float depth) {
+    // Non-negative floats order the same as their bit patterns
+    if (depth < 0.0f) depth = 0.0f;
+    uint32_t depthBits;
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+    if (pass == PASS_TRANSPARENT) depthBits = ~depthBits;
+
+    return (uint64_t)(pass & 0xF) << KEY_PASS_SHIFT |
+           (uint64_t)(program & 0xFF) << KEY_PROGRAM_SHIFT |
+           (uint64_t)(material & 0xFFF) << KEY_MATERIAL_SHIFT |
+           (uint64_t)(VAO & 0xFF) << KEY_VAO_SHIFT |
+           depthBits;
+}
+
+RenderQueue createRenderQueue(int capacity) {
+    RenderQueue queue = {0};
+    queue.capacity = capacity > 0 ? capacity : 1;
+    queue.keys = malloc(queue.capacity * sizeof(uint64_t));
+    queue.tempKeys = malloc(queue.capacity * sizeof(uint64_t));
+    queue.order = malloc(queue.capacity * sizeof(int));
+    queue.tempOrder = malloc(queue.capacity * sizeof(int));
+    queue.items = malloc(queue.capacity * sizeof(RenderItem));
+    return queue;
+}
+
+void clearRenderQueue(RenderQueue *queue) {
+    queue->count = 0;
+}
+
+void pushRenderItem(RenderQueue *queue, uint64_t key, RenderItem item) {
+    if (queue->count == queue->capacity) {
+        queue->capacity *= 2;
+        queue->keys = realloc(queue->keys, queue->capacity * sizeof(uint64_t));
+        queue->tempKeys = realloc(queue->tempKeys, queue->capacity * sizeof(uint64_t));
+        queue->order = realloc(queue->order, queue->capacity * sizeof(int));
+        queue->tempOrder = realloc(queue->tempOrder, queue->capacity * sizeof(int));
+        queue->items = realloc(queue->items, queue->capacity * sizeof(RenderItem));
+    }
+    queue->keys[queue->count] = key;
+    queue->order[queue->count] = queue->count;
+    queue->items[queue->count] = item;
+    queue->count++;
+}
+
+// LSD radix sort on bytes, stable, so equal keys keep submission order. A byte
+// every key shares is skipped, which drops most passes when the state fields repeat.
+void sortRenderQueue(RenderQueue *queue) {
+    int n = queue->count;
+    uint64_t *keys = queue->keys, *tempKeys = queue->tempKeys;
+    int *order = queue->order, *tempOrder = queue->tempOrder;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        int histogram[256] = {0};
+        for (int i = 0; i < n; i++) {
+            histogram[(keys[i] >> shift) & 0xFF]++;
+        }
+        if (n == 0 || histogram[(keys[0] >> shift) & 0xFF] == n)
+            continue;
+
+        int offset = 0;
+        for (int b = 0; b < 256; b++) {
+            int c = histogram[b];
+            histogram[b] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            int dst = histogram[(keys[i] >> shift) & 0xFF]++;
+            tempKeys[dst] = keys[i];
+            tempOrder[dst] = order[i];
+        }
+
+        uint64_t *swapKeys = keys; keys = tempKeys; tempKeys = swapKeys;
+        int *swapOrder = order; order = tempOrder; tempOrder = swapOrder;
+    }
+
+    queue->keys = keys;
+    queue->tempKeys = tempKeys;
+    queue->order = order;
+    queue->tempOrder = tempOrder;
+}
+
+void destroyRenderQueue(RenderQueue *queue) {
+    free(queue->keys);
+    free(queue->tempKeys);
+    free(queue->order);
+    free(queue->tempOrder);
+    free(queue->items);
+}
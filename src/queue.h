@@ -0,0 +1,46 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+
+// Sort key layout, most significant first:
+// pass (4 bits) | program (8) | material (12) | VAO (8) | depth (32)
+#define KEY_PASS_SHIFT      60
+#define KEY_PROGRAM_SHIFT   52
+#define KEY_MATERIAL_SHIFT  40
+#define KEY_VAO_SHIFT       32
+
+enum {
+    PASS_OPAQUE,
+    PASS_TRANSPARENT
+};
+
+enum {
+    RENDER_MESH,
+    RENDER_INSTANCES,
+    RENDER_INDIRECT
+};
+
+typedef struct renderItem {
+    int type;
+    const void *draw;           // Mesh, InstanceBatch or IndirectDraws depending on type
+    unsigned int program, VAO;
+    int object;                 // Object block to bind, -1 for none
+} RenderItem;
+
+// Draws collected over a frame and sorted by key before they are issued
+typedef struct renderQueue {
+    uint64_t *keys, *tempKeys;
+    int *order, *tempOrder;     // Items in sorted order
+    RenderItem *items;
+    int count, capacity;
+} RenderQueue;
+
+uint64_t renderKey(int pass, unsigned int program, unsigned int material, unsigned int VAO, float depth);
+RenderQueue createRenderQueue(int capacity);
+void clearRenderQueue(RenderQueue *queue);
+void pushRenderItem(RenderQueue *queue, uint64_t key, RenderItem item);
+void sortRenderQueue(RenderQueue *queue);
+void destroyRenderQueue(RenderQueue *queue);
+
+#endif
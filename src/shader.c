@@ -1,6 +1,8 @@
 #include <stdio.h>
+#include <string.h>
 #include <GL/glew.h>
 #include "shader.h"
+#include "glstats.h"
 
 const char* vertexShaderSource = R"(
 #version 330 core
@@ -13,18 +15,67 @@ out vec3 Normal;
 out vec3 FragPos;
 out vec3 ourColor;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// std140 layouts mirrored by FrameUniforms and ObjectUniforms in ubo.h
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 objectColor;
+};
+
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 normalMatrix; // Inverse transpose of model, keeps normals right under scaling
+};
 
 void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
+    Normal = normalMatrix * aNormal;
     ourColor = aColor;
 }
 )";
 
+// Same lighting, with the model and colour coming from per-instance attributes.
+// Object holds the transform shared by the whole batch.
+const char* instancedVertexShaderSource = R"(
+#version 330 core
+
+layout (location = 0) in vec3 aPos; // Vertex Position
+layout (location = 2) in vec3 aNormal; // Vertex Normal
+layout (location = 3) in mat4 aInstanceModel; // Instance transform, takes locations 3-6
+layout (location = 7) in vec3 aInstanceColor; // Instance Color
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec3 ourColor;
+
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 objectColor;
+};
+
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 normalMatrix;
+};
+
+void main() {
+    vec4 worldPos = model * aInstanceModel * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
+    FragPos = vec3(worldPos);
+    // Instances are rotated and uniformly scaled, the fragment shader renormalizes
+    Normal = normalMatrix * mat3(aInstanceModel) * aNormal;
+    ourColor = aInstanceColor;
+}
+)";
+
 const char* fragmentShaderSource = R"(
 #version 330 core
 
@@ -34,28 +85,32 @@ in vec3 ourColor;
 
 out vec4 FragColor;
 
-uniform vec3 lightPos; // Position of the light source
-uniform vec3 viewPos; // Position of the viewer
-uniform vec3 lightColor; // Color of the light source
-uniform vec3 objectColor; // Color of the object
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos; // Position of the viewer
+    vec4 lightPos; // Position of the light source
+    vec4 lightColor; // Color of the light source
+    vec4 objectColor; // Color of the object
+};
 
 void main() {
     // Ambient lighting
     float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
+    vec3 ambient = ambientStrength * lightColor.rgb;
 
     // Diffuse lighting
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 lightDir = normalize(lightPos.xyz - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = diff * lightColor.rgb;
 
     // Specular lighting
     float specularStrength = 0.5;
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;
+    vec3 specular = specularStrength * spec * lightColor.rgb;
 
     // Combine the lighting components
     vec3 result = (ambient + diffuse + specular) * ourColor;
@@ -63,10 +118,51 @@ void main() {
 }
 )";
 
-void loadShaders(unsigned int *shaderProgram) {
+static const char *blockNames[BLOCK_COUNT] = {"Frame", "Object"};
+
+// Ties every uniform block to its fixed binding point once, so buffers are bound
+// by index and nothing is looked up per frame
+static void reflectBlocks(ShaderProgram *program) {
+    for (int i = 0; i < BLOCK_COUNT; i++) {
+        program->blockSize[i] = -1;
+    }
+
+    int activeCount = 0;
+    glGetProgramiv(program->id, GL_ACTIVE_UNIFORM_BLOCKS, &activeCount);
+    for (int i = 0; i < activeCount; i++) {
+        char name[64];
+        glGetActiveUniformBlockName(program->id, i, sizeof(name), NULL, name);
+
+        int block = 0;
+        while (block < BLOCK_COUNT && strcmp(name, blockNames[block]) != 0) block++;
+        if (block == BLOCK_COUNT) {
+            printf("Shader uniform block %s is not known to the viewer\n", name);
+            continue;
+        }
+
+        glUniformBlockBinding(program->id, i, block);
+        glStats.setupUniformCalls++;
+        glGetActiveUniformBlockiv(program->id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &program->blockSize[block]);
+    }
+
+    int uniformCount = 0;
+    glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &uniformCount);
+    for (int i = 0; i < uniformCount; i++) {
+        unsigned int index = i;
+        int blockIndex;
+        glGetActiveUniformsiv(program->id, 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+        if (blockIndex < 0) {
+            char name[64];
+            glGetActiveUniformName(program->id, i, sizeof(name), NULL, name);
+            printf("Shader uniform %s is outside a block and never set\n", name);
+        }
+    }
+}
+
+static void linkShaders(ShaderProgram *program, const char *vertexSource, const char *fragmentSource) {
     // Compile vertex shader
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
     glCompileShader(vertexShader);
 
     // Check for vertex shader compilation errors
@@ -80,7 +176,7 @@ void loadShaders(unsigned int *shaderProgram) {
 
     // Compile fragment shader
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
     glCompileShader(fragmentShader);
 
     // Check for fragment shader compilation errors
@@ -91,19 +187,31 @@ void loadShaders(unsigned int *shaderProgram) {
     }
 
     // Link shaders into a program
-    *shaderProgram = glCreateProgram();
-    glAttachShader(*shaderProgram, vertexShader);
-    glAttachShader(*shaderProgram, fragmentShader);
-    glLinkProgram(*shaderProgram);
+    unsigned int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
 
     // Check for linking errors
-    glGetProgramiv(*shaderProgram, GL_LINK_STATUS, &success);
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(*shaderProgram, 512, NULL, infoLog);
+        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
         printf("Shader Program Linking Failed:\n%s\n", infoLog);
     }
 
     // Clean up shaders
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
-}
\ No newline at end of file
+
+    program->id = shaderProgram;
+    reflectBlocks(program);
+    glUseProgram(shaderProgram);
+}
+
+void loadShaders(ShaderProgram *program) {
+    linkShaders(program, vertexShaderSource, fragmentShaderSource);
+}
+
+void loadInstancedShaders(ShaderProgram *program) {
+    linkShaders(program, instancedVertexShaderSource, fragmentShaderSource);
+}
@@ -1,6 +1,19 @@
 #ifndef SHADER_H
 #define SHADER_H
 
-void loadShaders(unsigned int *shaderProgram);
+// Uniform block binding points, the same for every program
+enum {
+    BLOCK_FRAME,
+    BLOCK_OBJECT,
+    BLOCK_COUNT
+};
 
-#endif
\ No newline at end of file
+typedef struct shaderProgram {
+    unsigned int id;
+    int blockSize[BLOCK_COUNT];     // Bytes laid out by the linker, -1 when the block is unused
+} ShaderProgram;
+
+void loadShaders(ShaderProgram *program);
+void loadInstancedShaders(ShaderProgram *program);
+
+#endif
@@ -0,0 +1,459 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "softrast.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTRAST_SSE
+#endif
+
+#define VERTEX_FLOATS (sizeof(SoftVertex) / sizeof(float))
+
+// Same constants as the fragment shader
+#define AMBIENT_STRENGTH    0.1f
+#define SPECULAR_STRENGTH   0.5f
+
+static inline float min3(float a, float b, float c) { return a < b ? (a < c ? a : c) : (b < c ? b : c); }
+static inline float max3(float a, float b, float c) { return a > b ? (a > c ? a : c) : (b > c ? b : c); }
+
+static unsigned int packColor(float r, float g, float b) {
+    r = r < 0.0f ? 0.0f : (r > 1.0f ? 1.0f : r);
+    g = g < 0.0f ? 0.0f : (g > 1.0f ? 1.0f : g);
+    b = b < 0.0f ? 0.0f : (b > 1.0f ? 1.0f : b);
+    return (unsigned int)(r * 255.0f + 0.5f) | (unsigned int)(g * 255.0f + 0.5f) << 8 |
+           (unsigned int)(b * 255.0f + 0.5f) << 16 | 0xFF000000u;
+}
+
+static void addTriangle(SoftRasterizer *sr, const SoftVertex *a, const SoftVertex *b, const SoftVertex *c) {
+    const SoftVertex *v[3] = {a, b, c};
+    float sx[3], sy[3], invW[3];
+    for (int i = 0; i < 3; i++) {
+        invW[i] = 1.0f / v[i]->clip[3];
+        sx[i] = (v[i]->clip[0] * invW[i] * 0.5f + 0.5f) * sr->width;
+        sy[i] = (0.5f - v[i]->clip[1] * invW[i] * 0.5f) * sr->height;
+    }
+
+    float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+    if (area == 0.0f) return;
+    // Both windings are drawn, like the GL path without face culling
+    if (area < 0.0f) {
+        const SoftVertex *tv = v[1]; v[1] = v[2]; v[2] = tv;
+        float t = sx[1]; sx[1] = sx[2]; sx[2] = t;
+        t = sy[1]; sy[1] = sy[2]; sy[2] = t;
+        t = invW[1]; invW[1] = invW[2]; invW[2] = t;
+        area = -area;
+    }
+
+    int minX = (int)floorf(min3(sx[0], sx[1], sx[2])), maxX = (int)ceilf(max3(sx[0], sx[1], sx[2]));
+    int minY = (int)floorf(min3(sy[0], sy[1], sy[2])), maxY = (int)ceilf(max3(sy[0], sy[1], sy[2]));
+    if (minX < 0) minX = 0;
+    if (minY < 0) minY = 0;
+    if (maxX > sr->width - 1) maxX = sr->width - 1;
+    if (maxY > sr->height - 1) maxY = sr->height - 1;
+    if (minX > maxX || minY > maxY) return;
+
+    if (sr->triangleCount == sr->triangleCapacity) {
+        sr->triangleCapacity = sr->triangleCapacity ? sr->triangleCapacity * 2 : 1024;
+        sr->triangles = realloc(sr->triangles, sr->triangleCapacity * sizeof(SoftTriangle));
+    }
+    SoftTriangle *t = &sr->triangles[sr->triangleCount];
+    t->minX = minX; t->minY = minY; t->maxX = maxX; t->maxY = maxY;
+
+    // Edge i is opposite vertex i, so E_i / area is the weight of vertex i
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        t->edge[i][0] = sy[j] - sy[k];
+        t->edge[i][1] = sx[k] - sx[j];
+        t->edge[i][2] = sx[j] * sy[k] - sy[j] * sx[k];
+    }
+
+    // Linear in screen space: 1/w, depth and every attribute divided by w
+    float values[3][SOFT_ATTRIBUTES];
+    for (int i = 0; i < 3; i++) {
+        values[i][0] = invW[i];
+        values[i][1] = v[i]->clip[2] * invW[i];
+        const float *attributes = v[i]->pos;
+        for (int n = 0; n < 9; n++) {
+            values[i][2 + n] = attributes[n] * invW[i];
+        }
+    }
+    float inv = 1.0f / area;
+    for (int n = 0; n < SOFT_ATTRIBUTES; n++) {
+        for (int e = 0; e < 3; e++) {
+            t->plane[n][e] = (values[0][n] * t->edge[0][e] + values[1][n] * t->edge[1][e] + values[2][n] * t->edge[2][e]) * inv;
+        }
+    }
+
+    int index = sr->triangleCount++;
+    for (int ty = minY / SOFT_TILE_H; ty <= maxY / SOFT_TILE_H; ty++) {
+        for (int tx = minX / SOFT_TILE_W; tx <= maxX / SOFT_TILE_W; tx++) {
+            int tile = ty * sr->tilesX + tx;
+            if (sr->binCount[tile] == sr->binCapacity[tile]) {
+                sr->binCapacity[tile] = sr->binCapacity[tile] ? sr->binCapacity[tile] * 2 : 64;
+                sr->bins[tile] = realloc(sr->bins[tile], sr->binCapacity[tile] * sizeof(int));
+            }
+            sr->bins[tile][sr->binCount[tile]++] = index;
+        }
+    }
+}
+
+static void lerpVertex(SoftVertex *out, const SoftVertex *a, const SoftVertex *b, float t) {
+    const float *pa = a->clip, *pb = b->clip;
+    float *po = out->clip;
+    for (size_t i = 0; i < VERTEX_FLOATS; i++) {
+        po[i] = pa[i] + (pb[i] - pa[i]) * t;
+    }
+}
+
+// Only the near plane (z >= -w) is clipped, the screen edges are handled by the bounding boxes
+static void clipTriangle(SoftRasterizer *sr, const SoftVertex *a, const SoftVertex *b, const SoftVertex *c) {
+    const SoftVertex *in[3] = {a, b, c};
+    float d[3];
+    int outside = 0;
+    for (int i = 0; i < 3; i++) {
+        d[i] = in[i]->clip[2] + in[i]->clip[3];
+        if (d[i] < 0.0f) outside++;
+    }
+    if (outside == 0) {
+        addTriangle(sr, a, b, c);
+        return;
+    }
+    if (outside == 3) return;
+
+    SoftVertex poly[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        if (d[i] >= 0.0f) poly[count++] = *in[i];
+        if ((d[i] >= 0.0f) != (d[j] >= 0.0f))
+            lerpVertex(&poly[count++], in[i], in[j], d[i] / (d[i] - d[j]));
+    }
+    addTriangle(sr, &poly[0], &poly[1], &poly[2]);
+    if (count == 4)
+        addTriangle(sr, &poly[0], &poly[2], &poly[3]);
+}
+
+// Vertex stage, the same transforms as the vertex shader with model = mesh * scene
+static void setupMesh(SoftRasterizer *sr, const Mesh *mesh, const Mat4x4 *sceneModel) {
+    Mat4x4 model, modelView, clip;
+    Mat3x3 normal;
+    multiplyMatricesPtr(&model, &mesh->model, sceneModel);
+    normalMatrix(&normal, &model);
+    multiplyMatricesPtr(&modelView, &model, &sr->frame.view);
+    multiplyMatricesPtr(&clip, &modelView, &sr->frame.projection);
+
+    if (mesh->vertexCount > sr->vertexCapacity) {
+        sr->vertexCapacity = mesh->vertexCount;
+        sr->vertices = realloc(sr->vertices, sr->vertexCapacity * sizeof(SoftVertex));
+    }
+    // Positions go through the SoA transforms in batches small enough to stay in L1
+    for (int first = 0; first < mesh->vertexCount; first += SOFT_VERTEX_BATCH) {
+        int count = mesh->vertexCount - first < SOFT_VERTEX_BATCH ? mesh->vertexCount - first : SOFT_VERTEX_BATCH;
+        const Vertex *in = mesh->vertices + first;
+        SoftVertex *out = sr->vertices + first;
+        float x[SOFT_VERTEX_BATCH], y[SOFT_VERTEX_BATCH], z[SOFT_VERTEX_BATCH];
+        float clipX[SOFT_VERTEX_BATCH], clipY[SOFT_VERTEX_BATCH], clipZ[SOFT_VERTEX_BATCH], clipW[SOFT_VERTEX_BATCH];
+        for (int i = 0; i < count; i++) {
+            x[i] = in[i].x;
+            y[i] = in[i].y;
+            z[i] = in[i].z;
+        }
+        projectPositionsSoA(clipX, clipY, clipZ, clipW, &clip, x, y, z, count);
+        transformPositionsSoA(x, y, z, &model, x, y, z, count);
+
+        for (int i = 0; i < count; i++) {
+            out[i].clip[0] = clipX[i];
+            out[i].clip[1] = clipY[i];
+            out[i].clip[2] = clipZ[i];
+            out[i].clip[3] = clipW[i];
+            out[i].pos[0] = x[i];
+            out[i].pos[1] = y[i];
+            out[i].pos[2] = z[i];
+            for (int r = 0; r < 3; r++) {
+                out[i].normal[r] = normal.m[0][r] * in[i].nx + normal.m[1][r] * in[i].ny + normal.m[2][r] * in[i].nz;
+            }
+            out[i].color[0] = in[i].r;
+            out[i].color[1] = in[i].g;
+            out[i].color[2] = in[i].b;
+        }
+    }
+
+    for (int i = 0; i + 2 < mesh->indiceCount; i += 3) {
+        const SoftVertex *a = &sr->vertices[mesh->indices[i]];
+        const SoftVertex *b = &sr->vertices[mesh->indices[i + 1]];
+        const SoftVertex *c = &sr->vertices[mesh->indices[i + 2]];
+        // Entirely past one side of the frustum
+        int reject = 0;
+        for (int axis = 0; axis < 3 && !reject; axis++) {
+            if ((a->clip[axis] > a->clip[3] && b->clip[axis] > b->clip[3] && c->clip[axis] > c->clip[3]) ||
+                (a->clip[axis] < -a->clip[3] && b->clip[axis] < -b->clip[3] && c->clip[axis] < -c->clip[3]))
+                reject = 1;
+        }
+        if (!reject)
+            clipTriangle(sr, a, b, c);
+    }
+}
+
+#ifdef SOFTRAST_SSE
+static inline __m128 planeAt(const float *plane, __m128 px, __m128 rowValue) {
+    return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), px), rowValue);
+}
+
+static inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+static inline void normalize3(__m128 *x, __m128 *y, __m128 *z) {
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot3(*x, *y, *z, *x, *y, *z)));
+    *x = _mm_mul_ps(*x, inv);
+    *y = _mm_mul_ps(*y, inv);
+    *z = _mm_mul_ps(*z, inv);
+}
+
+static inline __m128i toByte(__m128 v) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+}
+
+// Four pixels of one row, interpolated and lit exactly like the fragment shader
+static int shadeQuad(const SoftRasterizer *sr, const SoftTriangle *t, int x, float py, float *depthRow, unsigned int *colorRow) {
+    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+    __m128 zero = _mm_setzero_ps();
+    // Lanes past the last column fall in the row padding, which is never cleared
+    __m128 inside = _mm_cmplt_ps(px, _mm_set1_ps((float)sr->width));
+    for (int e = 0; e < 3; e++) {
+        __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->edge[e][0]), px), _mm_set1_ps(t->edge[e][1] * py + t->edge[e][2]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(value, zero));
+    }
+    if (!_mm_movemask_ps(inside)) return 0;
+
+    __m128 z = planeAt(t->plane[1], px, _mm_set1_ps(t->plane[1][1] * py + t->plane[1][2]));
+    __m128 oldDepth = _mm_loadu_ps(depthRow + x);
+    __m128 pass = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(z, oldDepth), _mm_cmple_ps(z, _mm_set1_ps(1.0f))));
+    int mask = _mm_movemask_ps(pass);
+    if (!mask) return 0;
+    _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldDepth)));
+
+    __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), planeAt(t->plane[0], px, _mm_set1_ps(t->plane[0][1] * py + t->plane[0][2])));
+    __m128 a[9];
+    for (int n = 0; n < 9; n++) {
+        const float *plane = t->plane[2 + n];
+        a[n] = _mm_mul_ps(planeAt(plane, px, _mm_set1_ps(plane[1] * py + plane[2])), w);
+    }
+
+    __m128 nx = a[3], ny = a[4], nz = a[5];
+    normalize3(&nx, &ny, &nz);
+    __m128 lx = _mm_sub_ps(_mm_set1_ps(sr->frame.lightPos[0]), a[0]);
+    __m128 ly = _mm_sub_ps(_mm_set1_ps(sr->frame.lightPos[1]), a[1]);
+    __m128 lz = _mm_sub_ps(_mm_set1_ps(sr->frame.lightPos[2]), a[2]);
+    normalize3(&lx, &ly, &lz);
+    __m128 nDotL = dot3(nx, ny, nz, lx, ly, lz);
+    __m128 diff = _mm_max_ps(nDotL, zero);
+
+    __m128 vx = _mm_sub_ps(_mm_set1_ps(sr->frame.viewPos[0]), a[0]);
+    __m128 vy = _mm_sub_ps(_mm_set1_ps(sr->frame.viewPos[1]), a[1]);
+    __m128 vz = _mm_sub_ps(_mm_set1_ps(sr->frame.viewPos[2]), a[2]);
+    normalize3(&vx, &vy, &vz);
+    // reflect(-L, N) = 2 * dot(N, L) * N - L
+    __m128 twoNDotL = _mm_add_ps(nDotL, nDotL);
+    __m128 rx = _mm_sub_ps(_mm_mul_ps(twoNDotL, nx), lx);
+    __m128 ry = _mm_sub_ps(_mm_mul_ps(twoNDotL, ny), ly);
+    __m128 rz = _mm_sub_ps(_mm_mul_ps(twoNDotL, nz), lz);
+    __m128 spec = _mm_max_ps(dot3(vx, vy, vz, rx, ry, rz), zero);
+    for (int i = 0; i < 5; i++) {
+        spec = _mm_mul_ps(spec, spec);      // pow(spec, 32)
+    }
+
+    __m128 light = _mm_add_ps(_mm_add_ps(_mm_set1_ps(AMBIENT_STRENGTH), diff), _mm_mul_ps(_mm_set1_ps(SPECULAR_STRENGTH), spec));
+    __m128i r = toByte(_mm_mul_ps(_mm_mul_ps(light, _mm_set1_ps(sr->frame.lightColor[0])), a[6]));
+    __m128i g = toByte(_mm_mul_ps(_mm_mul_ps(light, _mm_set1_ps(sr->frame.lightColor[1])), a[7]));
+    __m128i b = toByte(_mm_mul_ps(_mm_mul_ps(light, _mm_set1_ps(sr->frame.lightColor[2])), a[8]));
+    __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                                _mm_or_si128(_mm_slli_epi32(b, 16), _mm_set1_epi32((int)0xFF000000u)));
+
+    __m128i keep = _mm_castps_si128(pass);
+    __m128i old = _mm_loadu_si128((const __m128i *)(colorRow + x));
+    _mm_storeu_si128((__m128i *)(colorRow + x), _mm_or_si128(_mm_and_si128(keep, rgba), _mm_andnot_si128(keep, old)));
+    return (mask & 1) + (mask >> 1 & 1) + (mask >> 2 & 1) + (mask >> 3 & 1);
+}
+#else
+static float planeAt(const float *plane, float px, float py) {
+    return plane[0] * px + plane[1] * py + plane[2];
+}
+
+static void normalize3(float *v) {
+    float inv = 1.0f / sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] *= inv; v[1] *= inv; v[2] *= inv;
+}
+
+static int shadePixel(const SoftRasterizer *sr, const SoftTriangle *t, int x, float py, float *depthRow, unsigned int *colorRow) {
+    float px = x + 0.5f;
+    for (int e = 0; e < 3; e++) {
+        if (t->edge[e][0] * px + t->edge[e][1] * py + t->edge[e][2] < 0.0f)
+            return 0;
+    }
+    float z = planeAt(t->plane[1], px, py);
+    if (z >= depthRow[x] || z > 1.0f)
+        return 0;
+    depthRow[x] = z;
+
+    float w = 1.0f / planeAt(t->plane[0], px, py);
+    float a[9];
+    for (int n = 0; n < 9; n++) {
+        a[n] = planeAt(t->plane[2 + n], px, py) * w;
+    }
+
+    float *pos = a, *norm = a + 3, *color = a + 6;
+    float lightDir[3], viewDir[3];
+    for (int i = 0; i < 3; i++) {
+        lightDir[i] = sr->frame.lightPos[i] - pos[i];
+        viewDir[i] = sr->frame.viewPos[i] - pos[i];
+    }
+    normalize3(norm);
+    normalize3(lightDir);
+    normalize3(viewDir);
+    float nDotL = norm[0] * lightDir[0] + norm[1] * lightDir[1] + norm[2] * lightDir[2];
+    float diff = nDotL > 0.0f ? nDotL : 0.0f;
+    float spec = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        spec += viewDir[i] * (2.0f * nDotL * norm[i] - lightDir[i]);
+    }
+    spec = spec > 0.0f ? powf(spec, 32.0f) : 0.0f;
+
+    float light = AMBIENT_STRENGTH + diff + SPECULAR_STRENGTH * spec;
+    colorRow[x] = packColor(light * sr->frame.lightColor[0] * color[0],
+                            light * sr->frame.lightColor[1] * color[1],
+                            light * sr->frame.lightColor[2] * color[2]);
+    return 1;
+}
+#endif
+
+static void rasterizeTile(SoftRasterizer *sr, int tile) {
+    int x0 = (tile % sr->tilesX) * SOFT_TILE_W, y0 = (tile / sr->tilesX) * SOFT_TILE_H;
+    int x1 = x0 + SOFT_TILE_W - 1, y1 = y0 + SOFT_TILE_H - 1;
+    if (x1 > sr->width - 1) x1 = sr->width - 1;
+    if (y1 > sr->height - 1) y1 = sr->height - 1;
+
+    // Each tile clears its own pixels, so the clear is spread over the workers too
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            sr->color[y * sr->stride + x] = sr->clearColor;
+            sr->depth[y * sr->stride + x] = 1.0f;
+        }
+    }
+
+    int fragments = 0;
+    for (int i = 0; i < sr->binCount[tile]; i++) {
+        const SoftTriangle *t = &sr->triangles[sr->bins[tile][i]];
+        int minX = t->minX > x0 ? t->minX : x0, maxX = t->maxX < x1 ? t->maxX : x1;
+        int minY = t->minY > y0 ? t->minY : y0, maxY = t->maxY < y1 ? t->maxY : y1;
+        for (int y = minY; y <= maxY; y++) {
+            float *depthRow = sr->depth + y * sr->stride;
+            unsigned int *colorRow = sr->color + y * sr->stride;
+#ifdef SOFTRAST_SSE
+            // Tiles start on multiples of four and rows are padded, so a quad never leaves the buffer
+            for (int x = minX & ~3; x <= maxX; x += 4) {
+                fragments += shadeQuad(sr, t, x, y + 0.5f, depthRow, colorRow);
+            }
+#else
+            for (int x = minX; x <= maxX; x++) {
+                fragments += shadePixel(sr, t, x, y + 0.5f, depthRow, colorRow);
+            }
+#endif
+        }
+    }
+    SDL_AtomicAdd(&sr->fragments, fragments);
+}
+
+static void rasterizeTiles(SoftRasterizer *sr) {
+    int tile;
+    while ((tile = SDL_AtomicAdd(&sr->nextTile, 1)) < sr->tilesX * sr->tilesY) {
+        rasterizeTile(sr, tile);
+    }
+}
+
+static int softWorker(void *data) {
+    SoftRasterizer *sr = data;
+    for (;;) {
+        SDL_SemWait(sr->start);
+        if (sr->quit) break;
+        rasterizeTiles(sr);
+        SDL_SemPost(sr->done);
+    }
+    return 0;
+}
+
+SoftRasterizer *createSoftRasterizer(int width, int height, int workerCount) {
+    SoftRasterizer *sr = calloc(1, sizeof(SoftRasterizer));
+    sr->width = width;
+    sr->height = height;
+    sr->stride = (width + 3) & ~3;
+    sr->color = malloc(sr->stride * height * sizeof(unsigned int));
+    sr->depth = malloc(sr->stride * height * sizeof(float));
+
+    sr->tilesX = (width + SOFT_TILE_W - 1) / SOFT_TILE_W;
+    sr->tilesY = (height + SOFT_TILE_H - 1) / SOFT_TILE_H;
+    int tiles = sr->tilesX * sr->tilesY;
+    sr->bins = calloc(tiles, sizeof(int *));
+    sr->binCount = calloc(tiles, sizeof(int));
+    sr->binCapacity = calloc(tiles, sizeof(int));
+
+    sr->start = SDL_CreateSemaphore(0);
+    sr->done = SDL_CreateSemaphore(0);
+    sr->workerCount = workerCount > 0 ? workerCount : 0;
+    sr->workers = calloc(sr->workerCount + 1, sizeof(SDL_Thread *));
+    for (int i = 0; i < sr->workerCount; i++) {
+        sr->workers[i] = SDL_CreateThread(softWorker, "softrast", sr);
+    }
+    return sr;
+}
+
+// Draws the visible meshes into sr->color with the same lighting as the GL shaders
+void renderSoft(SoftRasterizer *sr, const Mesh *meshes, int meshCount, const unsigned char *visible,
+                const Mat4x4 *sceneModel, const FrameUniforms *frame, const float *clearColor) {
+    sr->frame = *frame;
+    sr->clearColor = packColor(clearColor[0], clearColor[1], clearColor[2]);
+    sr->triangleCount = 0;
+    memset(sr->binCount, 0, sr->tilesX * sr->tilesY * sizeof(int));
+    for (int i = 0; i < meshCount; i++) {
+        if (!visible || visible[i])
+            setupMesh(sr, &meshes[i], sceneModel);
+    }
+
+    SDL_AtomicSet(&sr->nextTile, 0);
+    SDL_AtomicSet(&sr->fragments, 0);
+    for (int i = 0; i < sr->workerCount; i++) {
+        SDL_SemPost(sr->start);
+    }
+    rasterizeTiles(sr);
+    for (int i = 0; i < sr->workerCount; i++) {
+        SDL_SemWait(sr->done);
+    }
+    sr->fragmentCount = SDL_AtomicGet(&sr->fragments);
+}
+
+void destroySoftRasterizer(SoftRasterizer *sr) {
+    sr->quit = 1;
+    for (int i = 0; i < sr->workerCount; i++) {
+        SDL_SemPost(sr->start);
+    }
+    for (int i = 0; i < sr->workerCount; i++) {
+        SDL_WaitThread(sr->workers[i], NULL);
+    }
+    SDL_DestroySemaphore(sr->start);
+    SDL_DestroySemaphore(sr->done);
+
+    for (int i = 0; i < sr->tilesX * sr->tilesY; i++) {
+        free(sr->bins[i]);
+    }
+    free(sr->bins);
+    free(sr->binCount);
+    free(sr->binCapacity);
+    free(sr->triangles);
+    free(sr->vertices);
+    free(sr->color);
+    free(sr->depth);
+    free(sr->workers);
+    free(sr);
+}
@@ -0,0 +1,60 @@
+#ifndef SOFTRAST_H
+#define SOFTRAST_H
+
+#include <SDL2/SDL.h>
+#include "math3d.h"
+#include "mesh.h"
+#include "ubo.h"
+
+#define SOFT_TILE_W         32      // Multiple of four, rows are shaded four pixels at a time
+#define SOFT_TILE_H         32
+#define SOFT_ATTRIBUTES     11      // 1/w, depth, then position, normal and colour over w
+#define SOFT_VERTEX_BATCH   256     // Vertices transformed together, a multiple of eight
+
+// Clip space position followed by what the fragment shader gets
+typedef struct softVertex {
+    float clip[4];
+    float pos[3], normal[3], color[3];
+} SoftVertex;
+
+// Screen space triangle, every attribute set up as a plane a*x + b*y + c
+typedef struct softTriangle {
+    float edge[3][3];                   // Edge functions, positive on the inside
+    float plane[SOFT_ATTRIBUTES][3];
+    int minX, minY, maxX, maxY;
+} SoftTriangle;
+
+// CPU renderer for machines without a GPU: triangles are set up and binned to
+// tiles, then the tiles are depth tested and Phong shaded on worker threads
+typedef struct softRasterizer {
+    int width, height;
+    int stride;                         // Pixels per row, width rounded up to four
+    unsigned int *color;                // RGBA, top row first
+    float *depth;
+
+    SoftVertex *vertices;               // One mesh at a time after the vertex stage
+    int vertexCapacity;
+    SoftTriangle *triangles;
+    int triangleCount, triangleCapacity;
+
+    int tilesX, tilesY;
+    int **bins;                         // Triangles touching each tile
+    int *binCount, *binCapacity;
+
+    FrameUniforms frame;
+    unsigned int clearColor;
+    int fragmentCount;                  // Fragments that passed the depth test last frame
+
+    SDL_Thread **workers;
+    int workerCount;
+    SDL_sem *start, *done;
+    SDL_atomic_t nextTile, fragments;
+    int quit;
+} SoftRasterizer;
+
+SoftRasterizer *createSoftRasterizer(int width, int height, int workerCount);
+void renderSoft(SoftRasterizer *sr, const Mesh *meshes, int meshCount, const unsigned char *visible,
+                const Mat4x4 *sceneModel, const FrameUniforms *frame, const float *clearColor);
+void destroySoftRasterizer(SoftRasterizer *sr);
+
+#endif
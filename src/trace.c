@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "trace.h"
+
+typedef struct tracer {
+    int enabled;
+    SDL_TLSID tls;
+    TraceThread *threads[TRACE_THREADS];
+    SDL_atomic_t threadCount;
+    Uint64 epoch;
+
+    // Timestamp query pairs, issued and read back on the GL thread only
+    int gpu;
+    GLuint queries[TRACE_GPU_ZONES][2];
+    const char *gpuNames[TRACE_GPU_ZONES];
+    int gpuHead, gpuTail;
+    GLint64 gpuSync;                    // GPU nanoseconds at cpuSync
+    Uint64 cpuSync;
+    TraceThread *gpuThread;
+} Tracer;
+
+static Tracer tracer;
+
+void startTrace(void) {
+    tracer.tls = SDL_TLSCreate();
+    tracer.epoch = SDL_GetPerformanceCounter();
+    tracer.enabled = 1;
+}
+
+static TraceThread *addThread(const char *name) {
+    int i = SDL_AtomicAdd(&tracer.threadCount, 1);
+    if (i >= TRACE_THREADS) {
+        SDL_AtomicAdd(&tracer.threadCount, -1);
+        return NULL;
+    }
+    TraceThread *thread = calloc(1, sizeof(TraceThread));
+    thread->id = i + 1;
+    if (name)
+        snprintf(thread->name, sizeof(thread->name), "%s", name);
+    else
+        snprintf(thread->name, sizeof(thread->name), "thread %d", thread->id);
+    tracer.threads[i] = thread;
+    return thread;
+}
+
+static TraceThread *currentThread(void) {
+    TraceThread *thread = SDL_TLSGet(tracer.tls);
+    if (!thread) {
+        thread = addThread(NULL);
+        if (thread) SDL_TLSSet(tracer.tls, thread, NULL);
+    }
+    return thread;
+}
+
+void nameTraceThread(const char *name) {
+    if (!tracer.enabled) return;
+    TraceThread *thread = currentThread();
+    if (thread) snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+static void recordEvent(TraceThread *thread, const char *name, Uint64 start, Uint64 end) {
+    int head = SDL_AtomicGet(&thread->head);
+    TraceEvent *event = &thread->events[head % TRACE_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    SDL_AtomicSet(&thread->head, head + 1);
+}
+
+// GPU timestamps are mapped onto the performance counter from one pair of
+// readings taken here, needs the GL context to be current
+void syncGPUTrace(void) {
+    if (!tracer.enabled || !(GLEW_VERSION_3_3 || GLEW_ARB_timer_query)) return;
+    tracer.gpuThread = addThread("GPU");
+    if (!tracer.gpuThread) return;
+    glGenQueries(TRACE_GPU_ZONES * 2, &tracer.queries[0][0]);
+    glFinish();
+    glGetInteger64v(GL_TIMESTAMP, &tracer.gpuSync);
+    tracer.cpuSync = SDL_GetPerformanceCounter();
+    tracer.gpu = 1;
+}
+
+TraceZone beginZone(const char *name) {
+    TraceZone zone = {name, 0, -1};
+    if (tracer.enabled) zone.start = SDL_GetPerformanceCounter();
+    return zone;
+}
+
+void endZone(TraceZone zone) {
+    if (!tracer.enabled) return;
+    Uint64 end = SDL_GetPerformanceCounter();
+    TraceThread *thread = currentThread();
+    if (thread) recordEvent(thread, zone.name, zone.start, end);
+}
+
+// Times the zone on both timelines, the GPU one lands in the trace once
+// collectGPUTrace finds its timestamps ready
+TraceZone beginGPUZone(const char *name) {
+    TraceZone zone = beginZone(name);
+    if (tracer.gpu && tracer.gpuHead - tracer.gpuTail < TRACE_GPU_ZONES) {
+        zone.query = tracer.gpuHead++ % TRACE_GPU_ZONES;
+        tracer.gpuNames[zone.query] = name;
+        glQueryCounter(tracer.queries[zone.query][0], GL_TIMESTAMP);
+    }
+    return zone;
+}
+
+void endGPUZone(TraceZone zone) {
+    if (zone.query >= 0)
+        glQueryCounter(tracer.queries[zone.query][1], GL_TIMESTAMP);
+    endZone(zone);
+}
+
+static Uint64 gpuToCounter(GLuint64 ns) {
+    return tracer.cpuSync + (Sint64)((GLint64)ns - tracer.gpuSync) * (double)SDL_GetPerformanceFrequency() / 1e9;
+}
+
+// Reads back finished zones in issue order and stops at the first one still in flight
+void collectGPUTrace(void) {
+    while (tracer.gpuTail < tracer.gpuHead) {
+        GLuint *pair = tracer.queries[tracer.gpuTail % TRACE_GPU_ZONES];
+        GLint available = 0;
+        glGetQueryObjectiv(pair[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint64 start, end;
+        glGetQueryObjectui64v(pair[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(pair[1], GL_QUERY_RESULT, &end);
+        recordEvent(tracer.gpuThread, tracer.gpuNames[tracer.gpuTail % TRACE_GPU_ZONES], gpuToCounter(start), gpuToCounter(end));
+        tracer.gpuTail++;
+    }
+}
+
+static double toMicroseconds(Uint64 ticks) {
+    return (Sint64)(ticks - tracer.epoch) * 1e6 / SDL_GetPerformanceFrequency();
+}
+
+// Chrome trace event format, opens in chrome://tracing and ui.perfetto.dev.
+// Threads keep recording meanwhile, events overwritten during the copy are left out.
+int writeTrace(const char *path) {
+    if (!tracer.enabled) return 0;
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        printf("Could not open file %s\n", path);
+        return 0;
+    }
+
+    int written = 0, threadsWritten = 0;
+    fprintf(fp, "{\"traceEvents\":[\n");
+    int threadCount = SDL_AtomicGet(&tracer.threadCount);
+    for (int t = 0; t < threadCount; t++) {
+        TraceThread *thread = tracer.threads[t];
+        if (!thread) continue;
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                threadsWritten++ > 0 ? ",\n" : "", thread->id, thread->name);
+
+        int head = SDL_AtomicGet(&thread->head);
+        int first = head > TRACE_EVENTS ? head - TRACE_EVENTS + 1 : 0;
+        for (int i = first; i < head; i++) {
+            TraceEvent event = thread->events[i % TRACE_EVENTS];
+            if (SDL_AtomicGet(&thread->head) - i >= TRACE_EVENTS) continue;
+            double start = toMicroseconds(event.start);
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, thread->id, start, toMicroseconds(event.end) - start);
+            written++;
+        }
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+    printf("Wrote %d trace events from %d threads to %s\n", written, threadsWritten, path);
+    return 1;
+}
+
+// Every thread that recorded has to be finished with it
+void stopTrace(void) {
+    if (!tracer.enabled) return;
+    if (tracer.gpu) glDeleteQueries(TRACE_GPU_ZONES * 2, &tracer.queries[0][0]);
+    int threadCount = SDL_AtomicGet(&tracer.threadCount);
+    for (int t = 0; t < threadCount; t++) {
+        free(tracer.threads[t]);
+    }
+    memset(&tracer, 0, sizeof(tracer));
+}
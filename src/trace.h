@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <SDL2/SDL.h>
+
+#define TRACE_THREADS   32
+#define TRACE_EVENTS    16384   // Per thread, older events are overwritten
+#define TRACE_GPU_ZONES 128     // GPU zones waiting for their timestamps
+#define TRACE_NAME      32
+
+typedef struct traceEvent {
+    const char *name;
+    Uint64 start, end;                  // Performance counter ticks
+} TraceEvent;
+
+// Written only by its own thread. head counts every event ever recorded, the
+// writer fills the slot first and publishes it by bumping head, so a dump
+// running on another thread knows which slots it read may have been reused.
+typedef struct traceThread {
+    char name[TRACE_NAME];
+    int id;
+    SDL_atomic_t head;
+    TraceEvent events[TRACE_EVENTS];
+} TraceThread;
+
+typedef struct traceZone {
+    const char *name;
+    Uint64 start;
+    int query;                          // GPU zones only, -1 when no timestamps were issued
+} TraceZone;
+
+// Names have to outlive the trace, string literals in practice. Zones cost a
+// flag test while tracing is off.
+void startTrace(void);
+void syncGPUTrace(void);
+void nameTraceThread(const char *name);
+TraceZone beginZone(const char *name);
+void endZone(TraceZone zone);
+TraceZone beginGPUZone(const char *name);
+void endGPUZone(TraceZone zone);
+void collectGPUTrace(void);
+int writeTrace(const char *path);
+void stopTrace(void);
+
+#endif
@@ -0,0 +1,167 @@
+#include <math.h>
+#include "transform.h"
+
+Quat quatIdentity(void) {
+    Quat q = {0.0f, 0.0f, 0.0f, 1.0f};
+    return q;
+}
+
+// Axis has to be unit length, angle in radians
+Quat quatFromAxisAngle(float x, float y, float z, float angle) {
+    float s = sinf(angle * 0.5f);
+    Quat q = {x * s, y * s, z * s, cosf(angle * 0.5f)};
+    return q;
+}
+
+// Rotation b followed by rotation a
+Quat quatMultiply(Quat a, Quat b) {
+    Quat q = {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+    return q;
+}
+
+Quat quatConjugate(Quat q) {
+    Quat c = {-q.x, -q.y, -q.z, q.w};
+    return c;
+}
+
+Quat quatNormalize(Quat q) {
+    float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    if (length == 0.0f) return quatIdentity();
+    Quat n = {q.x / length, q.y / length, q.z / length, q.w / length};
+    return n;
+}
+
+static float quatDot(Quat a, Quat b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+// Normalized lerp along the shorter arc
+Quat quatNlerp(Quat a, Quat b, float t) {
+    float sign = quatDot(a, b) < 0.0f ? -1.0f : 1.0f;
+    Quat q = {
+        a.x + (b.x * sign - a.x) * t,
+        a.y + (b.y * sign - a.y) * t,
+        a.z + (b.z * sign - a.z) * t,
+        a.w + (b.w * sign - a.w) * t
+    };
+    return quatNormalize(q);
+}
+
+Quat quatSlerp(Quat a, Quat b, float t) {
+    float cosTheta = quatDot(a, b);
+    if (cosTheta < 0.0f) {
+        b = (Quat){-b.x, -b.y, -b.z, -b.w};
+        cosTheta = -cosTheta;
+    }
+    // Nearly parallel, nlerp is exact enough and avoids dividing by sin(0)
+    if (cosTheta > 0.9995f) return quatNlerp(a, b, t);
+
+    float theta = acosf(cosTheta);
+    float sinTheta = sinf(theta);
+    float wa = sinf((1.0f - t) * theta) / sinTheta;
+    float wb = sinf(t * theta) / sinTheta;
+    Quat q = {a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb};
+    return q;
+}
+
+// Matrices are written column by column, like the ones uploaded to GL
+static void rotationToMatrix(Mat4x4 *mat, Quat q, float scale) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    mat->m[0][0] = (1.0f - 2.0f * (yy + zz)) * scale;
+    mat->m[0][1] = 2.0f * (xy + wz) * scale;
+    mat->m[0][2] = 2.0f * (xz - wy) * scale;
+    mat->m[0][3] = 0.0f;
+
+    mat->m[1][0] = 2.0f * (xy - wz) * scale;
+    mat->m[1][1] = (1.0f - 2.0f * (xx + zz)) * scale;
+    mat->m[1][2] = 2.0f * (yz + wx) * scale;
+    mat->m[1][3] = 0.0f;
+
+    mat->m[2][0] = 2.0f * (xz + wy) * scale;
+    mat->m[2][1] = 2.0f * (yz - wx) * scale;
+    mat->m[2][2] = (1.0f - 2.0f * (xx + yy)) * scale;
+    mat->m[2][3] = 0.0f;
+}
+
+void quatToMatrix(Mat4x4 *mat, Quat q) {
+    rotationToMatrix(mat, q, 1.0f);
+    mat->m[3][0] = mat->m[3][1] = mat->m[3][2] = 0.0f;
+    mat->m[3][3] = 1.0f;
+}
+
+DualQuat dualQuatFromTransform(Quat rotation, const float *translation) {
+    Quat t = {translation[0], translation[1], translation[2], 0.0f};
+    Quat dual = quatMultiply(t, rotation);
+    DualQuat dq = {rotation, {dual.x * 0.5f, dual.y * 0.5f, dual.z * 0.5f, dual.w * 0.5f}};
+    return dq;
+}
+
+// Transform b followed by transform a
+DualQuat dualQuatMultiply(DualQuat a, DualQuat b) {
+    Quat d0 = quatMultiply(a.real, b.dual);
+    Quat d1 = quatMultiply(a.dual, b.real);
+    DualQuat dq = {quatMultiply(a.real, b.real), {d0.x + d1.x, d0.y + d1.y, d0.z + d1.z, d0.w + d1.w}};
+    return dq;
+}
+
+DualQuat dualQuatNormalize(DualQuat dq) {
+    float length = sqrtf(quatDot(dq.real, dq.real));
+    if (length == 0.0f) {
+        DualQuat identity = {quatIdentity(), {0.0f, 0.0f, 0.0f, 0.0f}};
+        return identity;
+    }
+    float inv = 1.0f / length;
+    DualQuat n = {
+        {dq.real.x * inv, dq.real.y * inv, dq.real.z * inv, dq.real.w * inv},
+        {dq.dual.x * inv, dq.dual.y * inv, dq.dual.z * inv, dq.dual.w * inv}
+    };
+    return n;
+}
+
+// Dual quaternion linear blending, good enough between nearby poses
+DualQuat dualQuatNlerp(DualQuat a, DualQuat b, float t) {
+    float sign = quatDot(a.real, b.real) < 0.0f ? -1.0f : 1.0f;
+    float wa = 1.0f - t, wb = t * sign;
+    DualQuat dq = {
+        {a.real.x * wa + b.real.x * wb, a.real.y * wa + b.real.y * wb, a.real.z * wa + b.real.z * wb, a.real.w * wa + b.real.w * wb},
+        {a.dual.x * wa + b.dual.x * wb, a.dual.y * wa + b.dual.y * wb, a.dual.z * wa + b.dual.z * wb, a.dual.w * wa + b.dual.w * wb}
+    };
+    return dualQuatNormalize(dq);
+}
+
+void dualQuatToMatrix(Mat4x4 *mat, DualQuat dq) {
+    rotationToMatrix(mat, dq.real, 1.0f);
+    Quat t = quatMultiply(dq.dual, quatConjugate(dq.real));
+    mat->m[3][0] = 2.0f * t.x;
+    mat->m[3][1] = 2.0f * t.y;
+    mat->m[3][2] = 2.0f * t.z;
+    mat->m[3][3] = 1.0f;
+}
+
+Transform createTransform(const float *position, float scale) {
+    Transform transform = {quatIdentity(), {position[0], position[1], position[2]}, scale};
+    return transform;
+}
+
+// Scale, then rotate, then translate
+void transformToMatrix(Mat4x4 *mat, const Transform *transform) {
+    rotationToMatrix(mat, transform->rotation, transform->scale);
+    mat->m[3][0] = transform->position[0];
+    mat->m[3][1] = transform->position[1];
+    mat->m[3][2] = transform->position[2];
+    mat->m[3][3] = 1.0f;
+}
+
+void transformsToMatrices(Mat4x4 *mats, const Transform *transforms, int count) {
+    for (int i = 0; i < count; i++) {
+        transformToMatrix(&mats[i], &transforms[i]);
+    }
+}
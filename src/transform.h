@@ -0,0 +1,40 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "math3d.h"
+
+typedef struct quat {
+    float x, y, z, w;
+} Quat;
+
+// Rigid transform: rotation in real, translation folded into dual
+typedef struct dualQuat {
+    Quat real, dual;
+} DualQuat;
+
+typedef struct transform {
+    Quat rotation;
+    float position[3];
+    float scale;
+} Transform;
+
+Quat quatIdentity(void);
+Quat quatFromAxisAngle(float x, float y, float z, float angle);
+Quat quatMultiply(Quat a, Quat b);
+Quat quatConjugate(Quat q);
+Quat quatNormalize(Quat q);
+Quat quatNlerp(Quat a, Quat b, float t);
+Quat quatSlerp(Quat a, Quat b, float t);
+void quatToMatrix(Mat4x4 *mat, Quat q);
+
+DualQuat dualQuatFromTransform(Quat rotation, const float *translation);
+DualQuat dualQuatMultiply(DualQuat a, DualQuat b);
+DualQuat dualQuatNormalize(DualQuat dq);
+DualQuat dualQuatNlerp(DualQuat a, DualQuat b, float t);
+void dualQuatToMatrix(Mat4x4 *mat, DualQuat dq);
+
+Transform createTransform(const float *position, float scale);
+void transformToMatrix(Mat4x4 *mat, const Transform *transform);
+void transformsToMatrices(Mat4x4 *mats, const Transform *transforms, int count);
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ubo.h"
+#include "glstats.h"
+
+UniformBuffers createUniformBuffers(const ShaderProgram *program, int objectCapacity) {
+    UniformBuffers ub = {0};
+
+    if (program->blockSize[BLOCK_FRAME] != (int)sizeof(FrameUniforms))
+        printf("Frame block is %d bytes, expected %d\n", program->blockSize[BLOCK_FRAME], (int)sizeof(FrameUniforms));
+    if (program->blockSize[BLOCK_OBJECT] != (int)sizeof(ObjectUniforms))
+        printf("Object block is %d bytes, expected %d\n", program->blockSize[BLOCK_OBJECT], (int)sizeof(ObjectUniforms));
+
+    int alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    ub.objectStride = ((int)sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+    ub.objectCapacity = objectCapacity > 0 ? objectCapacity : 1;
+    ub.objects = calloc(ub.objectCapacity, ub.objectStride);
+
+    glGenBuffers(1, &ub.frameBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ub.frameBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &ub.objectBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ub.objectBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)UBO_RING_FRAMES * ub.objectCapacity * ub.objectStride, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, BLOCK_FRAME, ub.frameBuffer);
+    return ub;
+}
+
+// Sends the frame block only when something in it changed
+void setFrameUniforms(UniformBuffers *ub, const FrameUniforms *frame) {
+    if (ub->frameUploaded && memcmp(&ub->frame, frame, sizeof(FrameUniforms)) == 0)
+        return;
+
+    ub->frame = *frame;
+    ub->frameUploaded = 1;
+    glBindBuffer(GL_UNIFORM_BUFFER, ub->frameBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glStats.bufferWrites++;
+}
+
+// Queues one draw's object block, returning the index to bind it with or -1 when full
+int addObjectUniforms(UniformBuffers *ub, const Mat4x4 *model, const Mat3x3 *normalMatrix) {
+    if (ub->objectCount == ub->objectCapacity)
+        return -1;
+
+    ObjectUniforms *object = (ObjectUniforms *)(ub->objects + (size_t)ub->objectCount * ub->objectStride);
+    object->model = *model;
+    for (int i = 0; i < 3; i++) {
+        object->normalMatrix[i][0] = normalMatrix->m[i][0];
+        object->normalMatrix[i][1] = normalMatrix->m[i][1];
+        object->normalMatrix[i][2] = normalMatrix->m[i][2];
+        object->normalMatrix[i][3] = 0.0f;
+    }
+    return ub->objectCount++;
+}
+
+// Blocks until the GPU has finished the draws that last read the slot
+static void waitForSlot(UniformBuffers *ub, int slot) {
+    if (!ub->fences[slot])
+        return;
+    GLenum status;
+    do {
+        status = glClientWaitSync(ub->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(ub->fences[slot]);
+    ub->fences[slot] = NULL;
+}
+
+// Writes every queued object block in one go and starts a new queue. Each frame goes
+// to the next slot of the ring, so the GPU can still read the last frames while this
+// one is written. Indices handed out stay bindable until the next upload.
+void uploadObjectUniforms(UniformBuffers *ub) {
+    // Every draw reading the current slot has been issued by now
+    if (ub->fences[ub->ring])
+        glDeleteSync(ub->fences[ub->ring]);
+    ub->fences[ub->ring] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ub->ring = (ub->ring + 1) % UBO_RING_FRAMES;
+    if (ub->objectCount == 0)
+        return;
+
+    // The write below is unsynchronized, so the fence is all that keeps it off a slot in use
+    waitForSlot(ub, ub->ring);
+
+    GLintptr offset = (GLintptr)ub->ring * ub->objectCapacity * ub->objectStride;
+    GLsizeiptr size = (GLsizeiptr)ub->objectCount * ub->objectStride;
+    glBindBuffer(GL_UNIFORM_BUFFER, ub->objectBuffer);
+    void *dst = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (dst) {
+        memcpy(dst, ub->objects, size);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    } else {
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, ub->objects);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glStats.bufferWrites++;
+    ub->objectCount = 0;
+}
+
+void bindObjectUniforms(UniformBuffers *ub, int object) {
+    GLintptr offset = ((GLintptr)ub->ring * ub->objectCapacity + object) * ub->objectStride;
+    glBindBufferRange(GL_UNIFORM_BUFFER, BLOCK_OBJECT, ub->objectBuffer, offset, sizeof(ObjectUniforms));
+    glStats.bufferBinds++;
+}
+
+void destroyUniformBuffers(UniformBuffers *ub) {
+    for (int i = 0; i < UBO_RING_FRAMES; i++) {
+        if (ub->fences[i]) glDeleteSync(ub->fences[i]);
+        ub->fences[i] = NULL;
+    }
+    glDeleteBuffers(1, &ub->frameBuffer);
+    glDeleteBuffers(1, &ub->objectBuffer);
+    free(ub->objects);
+    ub->objects = NULL;
+}
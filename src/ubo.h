@@ -0,0 +1,44 @@
+#ifndef UBO_H
+#define UBO_H
+
+#include "math3d.h"
+#include "shader.h"
+
+#define UBO_RING_FRAMES 3       // Frames the GPU may still be reading from the object buffer
+
+// std140 layout of the Frame block
+typedef struct frameUniforms {
+    Mat4x4 view, projection;
+    float viewPos[4];
+    float lightPos[4];
+    float lightColor[4];
+    float objectColor[4];
+} FrameUniforms;
+
+// std140 layout of the Object block, mat3 columns are padded to vec4
+typedef struct objectUniforms {
+    Mat4x4 model;
+    float normalMatrix[3][4];
+} ObjectUniforms;
+
+typedef struct uniformBuffers {
+    unsigned int frameBuffer, objectBuffer;
+    FrameUniforms frame;            // Last frame block sent
+    int frameUploaded;
+
+    unsigned char *objects;         // Staging for this frame's draws, objectStride apart
+    int objectStride;               // sizeof(ObjectUniforms) rounded up to the bind alignment
+    int objectCapacity;             // Draws per frame
+    int objectCount;
+    int ring;                       // Slot of the ring written this frame
+    GLsync fences[UBO_RING_FRAMES]; // Passed once the GPU is done with the draws of a slot
+} UniformBuffers;
+
+UniformBuffers createUniformBuffers(const ShaderProgram *program, int objectCapacity);
+void setFrameUniforms(UniformBuffers *ub, const FrameUniforms *frame);
+int addObjectUniforms(UniformBuffers *ub, const Mat4x4 *model, const Mat3x3 *normalMatrix);
+void uploadObjectUniforms(UniformBuffers *ub);
+void bindObjectUniforms(UniformBuffers *ub, int object);
+void destroyUniformBuffers(UniformBuffers *ub);
+
+#endif